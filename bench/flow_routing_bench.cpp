@@ -0,0 +1,83 @@
+// single flow direction (D8) against multi-flow routing (--mfd, findFlowWeights) on
+// the same terrain and rain; the time per step is reported per cell with water at
+// the start of the step, since multi-flow spreads the water over more cells
+//
+// flow_routing_bench [steps] [threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "depression_filling.hpp"
+#include "manning.hpp"
+#include "perlin_noise.hpp"
+#include "rain_field.hpp"
+
+namespace {
+
+constexpr size_t width = 2000;
+constexpr size_t height = 1600;
+constexpr float step_dt = 0.1f;          // [sec]
+constexpr uint32_t rain_offset = 45000;  // of the rain field
+
+void run(const bool& multi_flow, const size_t& steps, const size_t& threads) {
+    gbhs::ThreadPool pool(threads);
+    gbhs::SimulationData data(width, height);
+    siv::PerlinNoise perlin{42u};
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            data.height_map[data.cellIndex(x, y)] =
+                100.f * perlin.octave2D_01(x / 150.0, y / 150.0, 4) + 0.01f * x;
+        }
+    }
+    // as in gbhs, without filling most of the water stays in the pits
+    gbhs::fillDepressions(data.height_map, pool);
+    data.findNeighbours(pool);
+    auto t_weights = std::chrono::steady_clock::now();
+    if (multi_flow) {
+        data.findFlowWeights(pool);
+    }
+    double weight_seconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - t_weights)
+                                .count();
+    gbhs::Manning sim(data, pool);
+    gbhs::RainField rain_field(data, pool);
+    std::vector<gbhs::RainSpan> rain_spans;
+    rain_field.decide(rain_spans, {rain_offset, rain_offset});
+
+    double seconds = 0.0;
+    double cell_steps = 0.0;  // cells with water summed over the steps
+    for (size_t i = 0; i < steps; ++i) {
+        cell_steps += data.cellsWithWater().size();
+        auto t_start = std::chrono::steady_clock::now();
+        sim.step(step_dt, rain_spans, 0.f);
+        auto t_step = std::chrono::steady_clock::now() - t_start;
+        seconds += std::chrono::duration<double>(t_step).count();
+    }
+
+    double water = 0.0;  // [m] summed over the cells
+    for (const size_t& cell_idx : data.cellsWithWater()) {
+        water += data.waterLevel(cell_idx);
+    }
+    std::cout << (multi_flow ? "multi-flow: " : "D8:         ") << std::fixed
+              << std::setprecision(2) << seconds << "s, "
+              << seconds * 1e9 / std::max(1.0, cell_steps) << "ns per cell and step, "
+              << std::setprecision(3) << weight_seconds << "s for the weights, "
+              << data.cellsWithWater().size() << " cells with water, "
+              << std::setprecision(5) << water << "m of water" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const size_t steps = argc > 1 ? std::atoi(argv[1]) : 300;
+    const size_t threads = argc > 2 ? std::atoi(argv[2]) : 1;
+    std::cout << steps << " steps of " << width << "x" << height << " cells on "
+              << threads << " threads" << std::endl;
+    run(false, steps, threads);
+    run(true, steps, threads);
+    return 0;
+}
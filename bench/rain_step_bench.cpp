@@ -0,0 +1,99 @@
+// rain fused into Manning::step against rain added in a pass of its own before the
+// step; both put the rain into the level changes, so the apply sweep integrates
+// it with the inflow and evaporation in either case and the results agree up to
+// summation order
+//
+// rain_step_bench [steps] [threads] [rain offset]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "manning.hpp"
+#include "perlin_noise.hpp"
+#include "rain_field.hpp"
+
+namespace {
+
+constexpr size_t width = 2000;
+constexpr size_t height = 1600;
+constexpr float step_dt = 0.1f;        // [sec]
+constexpr size_t rain_interval = 150;  // [steps] until the rain field moves on
+
+// the path before rain was fused: one branch and possible push_back per cell
+void addRain(gbhs::SimulationData& data,
+             const std::vector<gbhs::RainSpan>& rain_spans,
+             const float& weight,
+             const float& dt) {
+    for (const gbhs::RainSpan& span : rain_spans) {
+        // a span lies inside one tile row, its cells are consecutive
+        size_t idx = data.cellIndex(span.x_begin, span.y);
+        for (size_t x = span.x_begin; x < span.x_end; ++x, ++idx) {
+            float rate = gbhs::rainRate(span, x, weight);
+            if (rate > 0.f) {
+                data.modifyWaterLevelChange(idx, rate * dt);
+            }
+        }
+    }
+}
+
+void run(const bool& fused,
+         const size_t& steps,
+         const size_t& threads,
+         const uint32_t& rain_offset) {
+    gbhs::ThreadPool pool(threads);
+    gbhs::SimulationData data(width, height);
+    siv::PerlinNoise perlin{42u};
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            data.height_map[data.cellIndex(x, y)] =
+                100.f * perlin.octave2D_01(x / 150.0, y / 150.0, 4) + 0.01f * x;
+        }
+    }
+    data.findNeighbours(pool);
+    gbhs::Manning sim(data, pool);
+    gbhs::RainField rain_field(data, pool);
+    std::vector<gbhs::RainSpan> rain_spans;
+    rain_field.decide(rain_spans, {rain_offset, rain_offset});
+
+    double seconds = 0.0;
+    for (size_t i = 0; i < steps; ++i) {
+        auto t_start = std::chrono::steady_clock::now();
+        if (fused) {
+            sim.step(step_dt, rain_spans, 0.f);
+        } else {
+            addRain(data, rain_spans, 0.f, step_dt);
+            sim.step(step_dt);
+        }
+        auto t_step = std::chrono::steady_clock::now() - t_start;
+        seconds += std::chrono::duration<double>(t_step).count();
+        if ((i + 1) % rain_interval == 0) {
+            uint32_t offset = rain_offset + (i + 1) / rain_interval * 250;
+            rain_field.decide(rain_spans, {offset, offset});
+        }
+    }
+
+    double water = 0.0;  // [m] summed over the cells
+    for (const size_t& cell_idx : data.cellsWithWater()) {
+        water += data.waterLevel(cell_idx);
+    }
+    std::cout << (fused ? "fused:    " : "separate: ") << std::fixed
+              << std::setprecision(2) << seconds << "s, "
+              << data.cellsWithWater().size() << " cells with water, "
+              << std::setprecision(5) << water << "m of water" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const size_t steps = argc > 1 ? std::atoi(argv[1]) : 300;
+    const size_t threads = argc > 2 ? std::atoi(argv[2]) : 1;
+    const uint32_t rain_offset = argc > 3 ? std::atoi(argv[3]) : 45000;
+    std::cout << steps << " steps of " << width << "x" << height << " cells on "
+              << threads << " threads" << std::endl;
+    run(false, steps, threads, rain_offset);
+    run(true, steps, threads, rain_offset);
+    return 0;
+}
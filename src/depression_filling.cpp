@@ -0,0 +1,120 @@
+#include "depression_filling.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace gbhs {
+
+namespace {
+
+constexpr int neighbour_dx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+constexpr int neighbour_dy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+
+// cells with data on the border of the raster or next to a cell without data
+void findSeeds(const Array2D<float, CellLayout>& height_map,
+               const size_t& row_begin,
+               const size_t& row_end,
+               std::vector<uint32_t>& seeds) {
+    const int width = height_map.width;
+    const int height = height_map.height;
+    height_map.forEachCell(row_begin, row_end, [&](int x, int y, size_t i) {
+        if (x >= width || height_map[i] < 0.f) {
+            return;
+        }
+        bool seed = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+        for (size_t d = 0; d < 8 && !seed; ++d) {
+            seed = height_map[height_map.idx(x + neighbour_dx[d], y + neighbour_dy[d])] <
+                   0.f;
+        }
+        if (seed) {
+            seeds.push_back(i);
+        }
+    });
+}
+
+}  // namespace
+
+void fillDepressions(Array2D<float, CellLayout>& height_map, ThreadPool& pool) {
+    const size_t width = height_map.width;
+    const size_t height = height_map.height;
+    // by the index of the layout, padding included
+    std::vector<uint64_t> closed((height_map.size() + 63) / 64, 0);
+    auto close = [&](const size_t& idx) {
+        closed[idx >> 6] |= uint64_t(1) << (idx & 63);
+    };
+    auto isClosed = [&](const size_t& idx) {
+        return (closed[idx >> 6] >> (idx & 63)) & 1;
+    };
+
+    // cells without data are never visited
+    std::vector<std::vector<uint32_t>> seeds(pool.size());
+    pool.parallelFor(height, [&](size_t begin, size_t end, size_t thread_idx) {
+        height_map.forEachCell(begin, end, [&](size_t x, size_t, size_t i) {
+            if (x < width && height_map[i] < 0.f) {
+                __atomic_fetch_or(
+                    &closed[i >> 6], uint64_t(1) << (i & 63), __ATOMIC_RELAXED);
+            }
+        });
+        findSeeds(height_map, begin, end, seeds[thread_idx]);
+    });
+
+    // open: cells in the order of their height, ties by index so that the result
+    // doesn't depend on the thread count; pit: cells that were raised, they are
+    // taken first and in fifo order, which is cheaper than the heap
+    using Entry = std::pair<float, uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    for (const std::vector<uint32_t>& thread_seeds : seeds) {
+        for (const uint32_t& idx : thread_seeds) {
+            close(idx);
+            open.push({height_map[idx], idx});
+        }
+    }
+    std::vector<uint32_t> pit;
+    size_t pit_front = 0;
+
+    while (!open.empty() || pit_front < pit.size()) {
+        uint32_t idx;
+        if (pit_front < pit.size() &&
+            !(!open.empty() && open.top().first == height_map[pit[pit_front]])) {
+            idx = pit[pit_front++];
+        } else {
+            idx = open.top().second;
+            open.pop();
+        }
+        if (pit_front == pit.size()) {
+            pit.clear();
+            pit_front = 0;
+        }
+
+        const Vec2ui c = height_map.coords(idx);
+        const int x = c.x;
+        const int y = c.y;
+        const float spill =
+            std::nextafter(height_map[idx], std::numeric_limits<float>::infinity());
+        for (size_t i = 0; i < 8; ++i) {
+            int nx = x + neighbour_dx[i];
+            int ny = y + neighbour_dy[i];
+            if (nx < 0 || ny < 0 || nx >= (int)width || ny >= (int)height) {
+                continue;
+            }
+            size_t neighbour_idx = height_map.idx(nx, ny);
+            if (isClosed(neighbour_idx)) {
+                continue;
+            }
+            close(neighbour_idx);
+            if (height_map[neighbour_idx] <= spill) {
+                height_map[neighbour_idx] = spill;
+                pit.push_back(neighbour_idx);
+            } else {
+                open.push({height_map[neighbour_idx], uint32_t(neighbour_idx)});
+            }
+        }
+    }
+}
+
+}  // namespace gbhs
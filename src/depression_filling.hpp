@@ -0,0 +1,18 @@
+#ifndef EXDIMUM_DEPRESSION_FILLING_H
+#define EXDIMUM_DEPRESSION_FILLING_H
+
+#include "thread_pool.hpp"
+#include "tiles.hpp"
+#include "utils.hpp"
+
+namespace gbhs {
+
+// priority-flood with epsilon (Barnes et al. 2014): raises every cell that can't
+// drain to the border of the raster or to a cell without data to just above the
+// cell it spills over, so that findNeighbours finds a strictly descending path out
+// of every depression. cells without data (negative) are left alone
+void fillDepressions(Array2D<float, CellLayout>& height_map, ThreadPool& pool);
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,428 @@
+#include "domain_decomposition.hpp"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <thread>
+
+#include "little_endian.hpp"
+
+namespace gbhs {
+
+namespace {
+
+constexpr auto connect_timeout = std::chrono::seconds(60);
+constexpr auto connect_retry = std::chrono::milliseconds(100);
+
+// one message each way over a socket, sent as its size in bytes and the bytes; the
+// size and the fields of the messages are little-endian, see little_endian.hpp
+struct Transfer {
+    int fd = -1;
+    const std::vector<char>* send = nullptr;  // nothing to send if nullptr
+    std::vector<char>* receive = nullptr;     // nothing to receive if nullptr
+
+    uint64_t send_size = 0;
+    uint8_t send_header[sizeof(uint64_t)] = {};
+    size_t sent = 0;
+    uint64_t receive_size = 0;
+    uint8_t receive_header[sizeof(uint64_t)] = {};
+    size_t received = 0;
+};
+
+bool sendDone(const Transfer& t) {
+    return t.send == nullptr || t.sent == sizeof(uint64_t) + t.send_size;
+}
+
+bool receiveDone(const Transfer& t) {
+    return t.receive == nullptr ||
+           (t.received >= sizeof(uint64_t) &&
+            t.received == sizeof(uint64_t) + t.receive_size);
+}
+
+// all transfers at once, so two ranks sending each other large messages can't
+// block on full socket buffers
+bool transfer(std::vector<Transfer>& transfers) {
+    for (Transfer& t : transfers) {
+        if (t.send != nullptr) {
+            t.send_size = t.send->size();
+            putU64(t.send_header, t.send_size);
+        }
+    }
+    std::vector<pollfd> fds;
+    std::vector<Transfer*> pending;
+    while (true) {
+        fds.clear();
+        pending.clear();
+        for (Transfer& t : transfers) {
+            short events = (sendDone(t) ? 0 : POLLOUT) | (receiveDone(t) ? 0 : POLLIN);
+            if (events != 0) {
+                fds.push_back({t.fd, events, 0});
+                pending.push_back(&t);
+            }
+        }
+        if (fds.empty()) {
+            return true;
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        for (size_t i = 0; i < fds.size(); ++i) {
+            Transfer& t = *pending[i];
+            if (fds[i].revents & (POLLERR | POLLNVAL)) {
+                return false;
+            }
+            if ((fds[i].revents & POLLOUT) && !sendDone(t)) {
+                // the size first, then the bytes
+                const char* data = t.sent < sizeof(uint64_t)
+                                       ? reinterpret_cast<const char*>(t.send_header)
+                                       : t.send->data();
+                size_t offset = t.sent < sizeof(uint64_t) ? t.sent
+                                                          : t.sent - sizeof(uint64_t);
+                size_t size = t.sent < sizeof(uint64_t) ? sizeof(uint64_t)
+                                                        : t.send_size;
+                ssize_t n = ::send(t.fd, data + offset, size - offset, MSG_NOSIGNAL);
+                if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                    return false;
+                }
+                t.sent += std::max<ssize_t>(0, n);
+            }
+            if ((fds[i].revents & (POLLIN | POLLHUP)) && !receiveDone(t)) {
+                char* data = t.received < sizeof(uint64_t)
+                                 ? reinterpret_cast<char*>(t.receive_header)
+                                 : t.receive->data();
+                size_t offset = t.received < sizeof(uint64_t)
+                                    ? t.received
+                                    : t.received - sizeof(uint64_t);
+                size_t size = t.received < sizeof(uint64_t) ? sizeof(uint64_t)
+                                                            : t.receive_size;
+                ssize_t n = recv(t.fd, data + offset, size - offset, 0);
+                if (n == 0) {
+                    return false;  // the neighbour is gone
+                }
+                if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                    return false;
+                }
+                t.received += std::max<ssize_t>(0, n);
+                if (t.received == sizeof(uint64_t)) {
+                    t.receive_size = getU64(t.receive_header);
+                    t.receive->resize(t.receive_size);
+                }
+            }
+        }
+    }
+}
+
+bool setNonBlocking(const int& fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// "host:port"
+bool resolve(const std::string& peer, addrinfo** address) {
+    size_t colon = peer.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    std::string host = peer.substr(0, colon);
+    return getaddrinfo(host.empty() ? nullptr : host.c_str(),
+                       peer.substr(colon + 1).c_str(),
+                       &hints,
+                       address) == 0;
+}
+
+}  // namespace
+
+bool partition(SimulationSettings& settings,
+               const size_t& rank,
+               const size_t& ranks,
+               Subdomain& domain) {
+    const size_t rows = settings.height;
+    if (ranks == 0 || rank >= ranks || ranks > rows) {
+        return false;
+    }
+    domain.rank = rank;
+    domain.ranks = ranks;
+    domain.row_begin = rank * rows / ranks;
+    domain.row_end = (rank + 1) * rows / ranks;
+    domain.halo_top = rank > 0 ? 1 : 0;
+    domain.halo_bottom = rank + 1 < ranks ? 1 : 0;
+    settings.offset_y += domain.row_begin - domain.halo_top;
+    settings.height =
+        domain.row_end - domain.row_begin + domain.halo_top + domain.halo_bottom;
+    return true;
+}
+
+bool spawnLocalRanks(const size_t& ranks, RankLinks& links) {
+    // pair r connects rank r (side 0) and rank r + 1 (side 1)
+    std::vector<int> pairs(2 * ranks, -1);
+    for (size_t r = 0; r + 1 < ranks; ++r) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, &pairs[2 * r]) != 0) {
+            return false;
+        }
+    }
+
+    // buffered output would be written by every process
+    fflush(nullptr);
+    links.rank = 0;
+    links.ranks = ranks;
+    for (size_t r = 1; r < ranks; ++r) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            return false;
+        }
+        if (pid == 0) {
+            links.rank = r;
+            links.children.clear();
+            break;
+        }
+        links.children.push_back(pid);
+    }
+
+    const size_t rank = links.rank;
+    for (size_t r = 0; r + 1 < ranks; ++r) {
+        for (size_t side = 0; side < 2; ++side) {
+            int fd = pairs[2 * r + side];
+            if (side == 1 && r + 1 == rank) {
+                links.up = fd;
+            } else if (side == 0 && r == rank) {
+                links.down = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+    return (links.up < 0 || setNonBlocking(links.up)) &&
+           (links.down < 0 || setNonBlocking(links.down));
+}
+
+bool connectRanks(const size_t& rank,
+                  const std::vector<std::string>& peers,
+                  RankLinks& links) {
+    if (rank >= peers.size()) {
+        return false;
+    }
+    links.rank = rank;
+    links.ranks = peers.size();
+
+    // listen before connecting, so the ranks can come up in any order
+    int listener = -1;
+    if (rank + 1 < peers.size()) {
+        addrinfo* address = nullptr;
+        if (!resolve(":" + peers[rank].substr(peers[rank].rfind(':') + 1), &address)) {
+            return false;
+        }
+        listener = socket(address->ai_family, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        bool listening = listener >= 0 &&
+                         bind(listener, address->ai_addr, address->ai_addrlen) == 0 &&
+                         listen(listener, 1) == 0;
+        freeaddrinfo(address);
+        if (!listening) {
+            close(listener);
+            return false;
+        }
+    }
+
+    if (rank > 0) {
+        addrinfo* address = nullptr;
+        if (!resolve(peers[rank - 1], &address)) {
+            close(listener);
+            return false;
+        }
+        auto deadline = std::chrono::steady_clock::now() + connect_timeout;
+        // the rank above may not listen yet
+        while (links.up < 0 && std::chrono::steady_clock::now() < deadline) {
+            int fd = socket(address->ai_family, SOCK_STREAM, 0);
+            if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+                links.up = fd;
+            } else {
+                close(fd);
+                std::this_thread::sleep_for(connect_retry);
+            }
+        }
+        freeaddrinfo(address);
+    }
+    if (listener >= 0) {
+        links.down = accept(listener, nullptr, nullptr);
+        close(listener);
+    }
+
+    int no_delay = 1;
+    for (int fd : {links.up, links.down}) {
+        if (fd >= 0) {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        }
+    }
+    return (rank == 0 || links.up >= 0) &&
+           (rank + 1 == peers.size() || links.down >= 0) &&
+           (links.up < 0 || setNonBlocking(links.up)) &&
+           (links.down < 0 || setNonBlocking(links.down));
+}
+
+bool closeRanks(RankLinks& links) {
+    for (int* fd : {&links.up, &links.down}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    bool success = true;
+    for (pid_t pid : links.children) {
+        int status = 0;
+        success &= waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+                   WEXITSTATUS(status) == 0;
+    }
+    links.children.clear();
+    return success;
+}
+
+HaloExchange::HaloExchange(SimulationData& data,
+                           Manning& sim,
+                           const Subdomain& domain,
+                           const RankLinks& links)
+    : data(data), sim(sim), domain(domain), links(links) {
+    // the top halo row first
+    std::vector<size_t> outlets;
+    const size_t width = data.dimensions.x;
+    const size_t height = data.dimensions.y;
+    for (size_t x = 0; domain.halo_top && x < width; ++x) {
+        outlets.push_back(data.cellIndex(x, 0));
+    }
+    for (size_t x = 0; domain.halo_bottom && x < width; ++x) {
+        outlets.push_back(data.cellIndex(x, height - 1));
+    }
+    sim.setOutlets(outlets);
+    // a failed exchange isn't retried, finishStep reports it
+    sim.setOutletExchange([this] {
+        exchanged = true;
+        success = success && exchange();
+    });
+}
+
+bool HaloExchange::finishStep() {
+    if (!exchanged) {
+        success = success && exchange();
+    }
+    exchanged = false;
+    return success;
+}
+
+void HaloExchange::pack(const size_t& first, std::vector<char>& message) {
+    std::vector<float>& inflow = sim.outletInflow();
+    message.clear();
+    for (size_t i = first; i < first + data.dimensions.x; ++i) {
+        if (inflow[i] > 0.f) {
+            size_t pos = message.size();
+            message.resize(pos + sizeof(uint32_t) + sizeof(float));
+            uint8_t* p = reinterpret_cast<uint8_t*>(&message[pos]);
+            putU32(p, i - first);
+            putF32(p + sizeof(uint32_t), inflow[i]);
+        }
+        inflow[i] = 0.f;
+    }
+}
+
+void HaloExchange::unpack(const std::vector<char>& message, const size_t& y) {
+    for (size_t pos = 0; pos + sizeof(uint32_t) + sizeof(float) <= message.size();
+         pos += sizeof(uint32_t) + sizeof(float)) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&message[pos]);
+        uint32_t x = getU32(p);
+        float amount = getF32(p + sizeof(uint32_t));
+        if (x >= data.dimensions.x) {
+            continue;
+        }
+        // a level change like any inflow, apply takes it from here
+        size_t cell_idx = data.cellIndex(x, y);
+        if (data.activate(cell_idx)) {
+            data.cellsWithWater().push_back(cell_idx);
+        }
+        data.waterLevelChange(cell_idx) += amount;
+    }
+}
+
+bool HaloExchange::exchange() {
+    std::vector<Transfer> transfers;
+    if (domain.halo_top) {
+        pack(0, send_up);
+        transfers.push_back({links.up, &send_up, &received_up});
+    }
+    if (domain.halo_bottom) {
+        pack(domain.halo_top ? data.dimensions.x : 0, send_down);
+        transfers.push_back({links.down, &send_down, &received_down});
+    }
+    if (!transfer(transfers)) {
+        return false;
+    }
+
+    // into the first and last owned row
+    if (domain.halo_top) {
+        unpack(received_up, domain.halo_top);
+    }
+    if (domain.halo_bottom) {
+        unpack(received_down, data.dimensions.y - 1 - domain.halo_bottom);
+    }
+    return true;
+}
+
+bool HaloExchange::allMin(float& value) {
+    // reduced from the last rank up to rank 0, which sends the result back down
+    std::vector<char> own(sizeof(float));
+    std::vector<char> other;
+    std::vector<Transfer> transfers;
+    if (links.down >= 0) {
+        transfers = {{links.down, nullptr, &other}};
+        if (!transfer(transfers) || other.size() != sizeof(float)) {
+            return false;
+        }
+        float below = getF32(reinterpret_cast<const uint8_t*>(other.data()));
+        value = std::min(value, below);
+    }
+    if (links.up >= 0) {
+        putF32(reinterpret_cast<uint8_t*>(own.data()), value);
+        transfers = {{links.up, &own, &other}};
+        if (!transfer(transfers) || other.size() != sizeof(float)) {
+            return false;
+        }
+        value = getF32(reinterpret_cast<const uint8_t*>(other.data()));
+    }
+    if (links.down >= 0) {
+        putF32(reinterpret_cast<uint8_t*>(own.data()), value);
+        transfers = {{links.down, &own, nullptr}};
+        return transfer(transfers);
+    }
+    return true;
+}
+
+void HaloExchange::ownedSpans(const std::vector<RainSpan>& spans,
+                              std::vector<RainSpan>& owned) const {
+    const uint32_t y_begin = domain.halo_top;
+    const uint32_t y_end = data.dimensions.y - domain.halo_bottom;
+    owned.clear();
+    std::copy_if(
+        spans.begin(), spans.end(), std::back_inserter(owned), [&](const RainSpan& span) {
+            return span.y >= y_begin && span.y < y_end;
+        });
+}
+
+}  // namespace gbhs
@@ -0,0 +1,99 @@
+#ifndef EXDIMUM_DOMAIN_DECOMPOSITION_H
+#define EXDIMUM_DOMAIN_DECOMPOSITION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "manning.hpp"
+#include "rain_field.hpp"
+#include "simulation_data.hpp"
+
+namespace gbhs {
+
+// distributed runs: the window is split into horizontal strips, one per process
+// (rank). a rank loads its strip and one halo row of each neighbouring strip, so
+// flow directions at the strip borders are the same as in one process. the halo
+// rows are outlets (see Manning::setOutlets): what flowed into them is sent to the
+// rank that owns them and added to the level changes of its border row, within the
+// step before they are applied, so border cells integrate like any other cell
+
+struct Subdomain {
+    size_t rank = 0;
+    size_t ranks = 1;
+    // owned rows [row_begin, row_end) of the original window
+    int32_t row_begin = 0;
+    int32_t row_end = 0;
+    // halo rows of the rank's window above and below the owned rows, 0 or 1
+    int32_t halo_top = 0;
+    int32_t halo_bottom = 0;
+};
+
+// strip of rank, the window of settings becomes the strip with its halo rows;
+// false if there are more ranks than rows
+bool partition(SimulationSettings& settings,
+               const size_t& rank,
+               const size_t& ranks,
+               Subdomain& domain);
+
+// stream sockets to the ranks above and below, -1 if there is none
+struct RankLinks {
+    size_t rank = 0;
+    size_t ranks = 1;
+    int up = -1;
+    int down = -1;
+    std::vector<pid_t> children;  // of rank 0 with spawnLocalRanks
+};
+
+// forks ranks - 1 processes connected by socket pairs, every process returns with
+// its own rank; has to happen before any thread is started
+bool spawnLocalRanks(const size_t& ranks, RankLinks& links);
+// for one process per "host:port" of peers, e.g. started by a cluster launcher or
+// on loopback: rank listens on its own port for the rank below and connects to the
+// rank above
+bool connectRanks(const size_t& rank,
+                  const std::vector<std::string>& peers,
+                  RankLinks& links);
+// closes the links; rank 0 waits for the processes of spawnLocalRanks, false if one
+// of them failed
+bool closeRanks(RankLinks& links);
+
+class HaloExchange {
+   public:
+    HaloExchange(SimulationData& data,
+                 Manning& sim,
+                 const Subdomain& domain,
+                 const RankLinks& links);
+
+    // exchanges the outlet inflow of a multi-rate step, where it waits in the level
+    // changes until the border tiles step (steps of one dt exchange by themselves);
+    // false if a neighbour is gone, also during a step
+    bool finishStep();
+    // minimum of value over all ranks
+    bool allMin(float& value);
+    // the spans of owned rows
+    void ownedSpans(const std::vector<RainSpan>& spans,
+                    std::vector<RainSpan>& owned) const;
+
+   private:
+    // sends the outlet inflow since the last exchange to the neighbours and adds
+    // what they sent to the level changes of the border rows
+    bool exchange();
+    // outlet inflow of the halo row starting at outlet first as (x, amount) pairs
+    void pack(const size_t& first, std::vector<char>& message);
+    void unpack(const std::vector<char>& message, const size_t& y);
+
+    SimulationData& data;
+    Manning& sim;
+    Subdomain domain;
+    RankLinks links;
+    std::vector<char> send_up, send_down, received_up, received_down;
+    bool exchanged = false;  // by the current step
+    bool success = true;
+};
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef EXDIMUM_FAST_MATH_H
+#define EXDIMUM_FAST_MATH_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace gbhs {
+
+// x^(2/3) for x >= 0, relative error below 2e-5
+// x^(-1/3) is guessed from the exponent bits and refined by two newton steps,
+// x^(2/3) = x * x^(-1/3) then needs no division
+inline float fastPow2_3(const float& x) {
+    uint32_t i;
+    std::memcpy(&i, &x, sizeof(float));
+    i = 0x54a2fa8eu - i / 3;
+    float y;
+    std::memcpy(&y, &i, sizeof(float));
+    y = y * (4.f - x * y * y * y) * (1.f / 3.f);
+    y = y * (4.f - x * y * y * y) * (1.f / 3.f);
+    return x * y;
+}
+
+}  // namespace gbhs
+
+#endif
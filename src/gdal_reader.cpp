@@ -0,0 +1,127 @@
+#include "gdal_reader.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "depression_filling.hpp"
+#include "gdal_priv.h"
+
+namespace gbhs {
+
+bool readGDALData(const char* file,
+                  Array2D<float, CellLayout>& height_map,
+                  const int32_t& offset_x,
+                  const int32_t& offset_y,
+                  const std::function<void(size_t)>& rows_loaded) {
+    const int32_t width = height_map.width;
+    const int32_t height = height_map.height;
+    GDALAllRegister();
+    GDALDataset* dataset = (GDALDataset*)GDALOpen(file, GA_ReadOnly);
+    if (dataset == NULL) {
+        return false;  // no compatible driver found
+    }
+    if (dataset->GetRasterCount() < 1 || offset_x < 0 || offset_y < 0 ||
+        offset_x + width > dataset->GetRasterXSize() ||
+        offset_y + height > dataset->GetRasterYSize()) {
+        GDALClose(dataset);
+        return false;
+    }
+
+    GDALRasterBand* band =
+        dataset->GetRasterBand(1);  // assume that there is only one band
+
+    // walk the tiles of the window row by row, every read covers one tile and lands
+    // directly at its place in the height map (lines of tile_size floats); GDAL
+    // caches the blocks a row of tiles touches
+    bool success = true;
+    for (int32_t y = 0; success && y < height; y += tile_size) {
+        int32_t y_end = std::min<int32_t>(height, y + tile_size);
+        for (int32_t x = 0; success && x < width; x += tile_size) {
+            int32_t x_end = std::min<int32_t>(width, x + tile_size);
+            float* tile = &height_map[height_map.idx(x, y)];
+            CPLErr err = band->RasterIO(GF_Read,                     // mode
+                                        offset_x + x,                // offset x
+                                        offset_y + y,                // offset y
+                                        x_end - x,                   // size x
+                                        y_end - y,                   // size y
+                                        tile,                        // buffer
+                                        x_end - x,                   // buffer size x
+                                        y_end - y,                   // buffer size y
+                                        GDT_Float32,                 // format
+                                        0,                           // pixel space
+                                        sizeof(float) * tile_size);  // line space
+            success = err == CE_None;
+        }
+        if (success && rows_loaded) {
+            rows_loaded(y_end);
+        }
+    }
+    GDALClose(dataset);
+    return success;
+}
+
+bool loadHeightMap(const char* file,
+                   const SimulationSettings& settings,
+                   SimulationData& data,
+                   ThreadPool& pool) {
+    std::mutex mutex;
+    std::condition_variable progress;
+    size_t rows_loaded = 0;
+    bool finished = false;
+    bool success = false;
+
+    // the reader thread would place every page of the height map; under first touch
+    // they go to the threads that work on its rows instead
+    if (settings.memory.numa_policy == NumaPolicy::first_touch) {
+        touchPages(data.height_map.ptr(), sizeof(float) * data.height_map.size(), pool);
+    }
+
+    std::thread reader([&]() {
+        bool result = readGDALData(file,
+                                   data.height_map,
+                                   settings.offset_x,
+                                   settings.offset_y,
+                                   [&](size_t rows) {
+                                       std::lock_guard<std::mutex> lock(mutex);
+                                       rows_loaded = rows;
+                                       progress.notify_one();
+                                   });
+        std::lock_guard<std::mutex> lock(mutex);
+        success = result;
+        finished = true;
+        progress.notify_one();
+    });
+
+    // the last loaded row still misses its lower neighbours; filling depressions needs
+    // the whole height map first
+    const bool overlap = !settings.fill_depressions;
+    size_t rows_done = 0;
+    while (true) {
+        size_t rows_ready = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            progress.wait(lock, [&] {
+                return finished || (overlap && rows_loaded > rows_done + 1);
+            });
+            if (finished && !success) {
+                break;
+            }
+            rows_ready = finished ? data.dimensions.y : rows_loaded - 1;
+        }
+        if (!overlap) {
+            fillDepressions(data.height_map, pool);
+        }
+        data.findNeighbours(rows_done, rows_ready, pool);
+        rows_done = rows_ready;
+        if (rows_done == data.dimensions.y) {
+            break;
+        }
+    }
+
+    reader.join();
+    return success;
+}
+
+}  // namespace gbhs
@@ -0,0 +1,31 @@
+#ifndef EXDIMUM_GDAL_READER_H
+#define EXDIMUM_GDAL_READER_H
+
+#include <cstdint>
+#include <functional>
+
+#include "simulation_data.hpp"
+#include "thread_pool.hpp"
+
+namespace gbhs {
+
+// reads the window at (offset_x, offset_y) of the size of height_map into it, tile by
+// tile of the cell layout; rows_loaded(n) is called whenever the first n rows of the
+// window are complete. false if the file can't be opened or read
+bool readGDALData(const char* file,
+                  Array2D<float, CellLayout>& height_map,
+                  const int32_t& offset_x,
+                  const int32_t& offset_y,
+                  const std::function<void(size_t)>& rows_loaded = nullptr);
+
+// reads the height map on a background thread while findNeighbours already runs
+// on the rows that are loaded; with settings.fill_depressions the height map is
+// filled once it is complete and findNeighbours runs after that
+bool loadHeightMap(const char* file,
+                   const SimulationSettings& settings,
+                   SimulationData& data,
+                   ThreadPool& pool);
+
+}  // namespace gbhs
+
+#endif
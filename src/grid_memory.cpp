@@ -0,0 +1,139 @@
+#include "grid_memory.hpp"
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace gbhs {
+
+namespace {
+
+constexpr size_t huge_page_size = size_t(2) << 20;
+
+// online NUMA nodes as an mbind node mask, empty if there is only one
+std::vector<unsigned long> onlineNodes() {
+    std::ifstream rs("/sys/devices/system/node/online");
+    std::string list;
+    std::vector<unsigned long> mask;
+    size_t node_count = 0;
+    if (!std::getline(rs, list)) {
+        return mask;
+    }
+    // comma separated ranges, e.g. "0-1,4"
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        end = end == std::string::npos ? list.size() : end;
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        unsigned long first = std::stoul(range.substr(0, dash));
+        unsigned long last =
+            dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (unsigned long node = first; node <= last; ++node) {
+            constexpr size_t word_bits = 8 * sizeof(unsigned long);
+            mask.resize(std::max(mask.size(), node / word_bits + 1), 0);
+            mask[node / word_bits] |= 1ul << (node % word_bits);
+            ++node_count;
+        }
+        pos = end + 1;
+    }
+    if (node_count < 2) {
+        mask.clear();
+    }
+    return mask;
+}
+
+// the tail beyond an aligned region is unmapped again
+void* mapAligned(const size_t& bytes, const size_t& alignment) {
+    void* mapping = mmap(nullptr,
+                         bytes + alignment,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                         -1,
+                         0);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t begin = reinterpret_cast<uintptr_t>(mapping);
+    uintptr_t aligned = (begin + alignment - 1) & ~(alignment - 1);
+    if (aligned > begin) {
+        munmap(mapping, aligned - begin);
+    }
+    munmap(reinterpret_cast<void*>(aligned + bytes), begin + alignment - aligned);
+    return reinterpret_cast<void*>(aligned);
+}
+
+}  // namespace
+
+std::shared_ptr<void> allocatePages(const size_t& bytes, const GridMemory& memory) {
+    // small arrays would waste most of a huge page
+    const bool huge = memory.huge_pages && bytes >= huge_page_size;
+    const size_t page_size = huge ? huge_page_size : size_t(sysconf(_SC_PAGESIZE));
+    const size_t size =
+        std::max<size_t>(1, (bytes + page_size - 1) / page_size) * page_size;
+
+    void* ptr = MAP_FAILED;
+    if (huge) {
+        // reserved huge pages are all or nothing, transparent ones need the alignment
+        ptr = mmap(nullptr,
+                   size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                   -1,
+                   0);
+        if (ptr == MAP_FAILED) {
+            void* aligned = mapAligned(size, huge_page_size);
+            if (aligned != nullptr) {
+                ptr = aligned;
+                madvise(ptr, size, MADV_HUGEPAGE);
+            }
+        }
+    } else {
+        ptr = mmap(nullptr,
+                   size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                   -1,
+                   0);
+    }
+    if (ptr == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    // without a policy the kernel places pages on first touch
+    if (memory.numa_policy == NumaPolicy::interleave) {
+        static const std::vector<unsigned long> nodes = onlineNodes();
+        if (!nodes.empty()) {
+            syscall(SYS_mbind,
+                    ptr,
+                    size,
+                    MPOL_INTERLEAVE,
+                    nodes.data(),
+                    8 * sizeof(unsigned long) * nodes.size() + 1,
+                    0);
+        }
+    }
+    return std::shared_ptr<void>(ptr, [size](void* p) { munmap(p, size); });
+}
+
+void touchPages(void* ptr, const size_t& bytes, ThreadPool& pool) {
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    char* begin = static_cast<char*>(ptr);
+    pool.parallelFor(bytes, [&](size_t chunk_begin, size_t chunk_end, size_t) {
+        // a page on a chunk border is touched twice, the adds of 0 keep its content
+        for (size_t i = chunk_begin / page_size * page_size; i < chunk_end;
+             i += page_size) {
+            __atomic_fetch_add(begin + i, 0, __ATOMIC_RELAXED);
+        }
+    });
+}
+
+}  // namespace gbhs
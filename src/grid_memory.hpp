@@ -0,0 +1,52 @@
+#ifndef EXDIMUM_GRID_MEMORY_H
+#define EXDIMUM_GRID_MEMORY_H
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+namespace gbhs {
+
+// where the pages of a grid array end up on a NUMA machine
+enum class NumaPolicy {
+    first_touch,  // on the node of the thread that writes a page first (kernel default)
+    interleave,   // round-robin over all nodes
+};
+
+struct GridMemory {
+    // 2 MB pages: hugetlbfs pages if the system reserved some, transparent huge
+    // pages otherwise; pays off with many TLB misses, faults may stall on compaction
+    bool huge_pages = false;
+    NumaPolicy numa_policy = NumaPolicy::first_touch;
+};
+
+// zeroed memory from an anonymous mapping, unmapped with the last reference; pages
+// are only placed when they are touched, see touchPages; throws std::bad_alloc
+std::shared_ptr<void> allocatePages(const size_t& bytes, const GridMemory& memory);
+
+// faults in the pages of [ptr, ptr + bytes) from the pool, split like parallelFor;
+// under first touch every thread gets the pages of the band it works on later
+void touchPages(void* ptr, const size_t& bytes, ThreadPool& pool);
+
+template <typename T>
+std::shared_ptr<T[]> allocateGrid(const size_t& count, const GridMemory& memory) {
+    static_assert(std::is_trivially_default_constructible<T>::value,
+                  "grid memory is zeroed, not constructed");
+    std::shared_ptr<void> pages = allocatePages(sizeof(T) * count, memory);
+    return std::shared_ptr<T[]>(pages, static_cast<T*>(pages.get()));
+}
+
+template <typename T, typename Layout = RowMajorLayout>
+Array2D<T, Layout> gridArray(const size_t& width,
+                             const size_t& height,
+                             const GridMemory& memory) {
+    return Array2D<T, Layout>(
+        width, height, allocateGrid<T>(Layout::storageSize(width, height), memory));
+}
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,135 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GBHS_X86 1
+#endif
+
+namespace gbhs {
+
+namespace {
+
+void applyDenseScalar(float* level,
+                      float* change,
+                      const size_t& count,
+                      const float& evaporation) {
+    for (size_t i = 0; i < count; ++i) {
+        level[i] = std::max(0.f, level[i] + change[i] - evaporation);
+        change[i] = 0.0f;
+    }
+}
+
+void applySparseScalar(HydraulicTile* const* tiles,
+                       const size_t* cells,
+                       const size_t& count,
+                       const float& evaporation) {
+    for (size_t k = 0; k < count; ++k) {
+        HydraulicTile* tile = tiles[cells[k] >> tile_cell_bits];
+        size_t i = cells[k] & (tile_cells - 1);
+        tile->water_level[i] = std::max(
+            0.f, tile->water_level[i] + tile->water_level_change[i] - evaporation);
+        tile->water_level_change[i] = 0.0f;
+    }
+}
+
+#ifdef GBHS_X86
+static_assert(offsetof(HydraulicTile, water_level_change) == sizeof(float) * tile_cells,
+              "the sparse kernel expects the level changes right after the levels");
+
+// max(v, 0) returns 0 for v <= 0 and NaN, just like std::max(0.f, v)
+
+__attribute__((target("avx2"))) void applyDenseAvx2(float* level,
+                                                    float* change,
+                                                    const size_t& count,
+                                                    const float& evaporation) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 evap = _mm256_set1_ps(evaporation);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 l = _mm256_loadu_ps(level + i);
+        __m256 c = _mm256_loadu_ps(change + i);
+        l = _mm256_max_ps(_mm256_sub_ps(_mm256_add_ps(l, c), evap), zero);
+        _mm256_storeu_ps(level + i, l);
+        _mm256_storeu_ps(change + i, zero);
+    }
+    applyDenseScalar(level + i, change + i, count - i, evaporation);
+}
+
+__attribute__((target("avx2"))) void applySparseAvx2(HydraulicTile* const* tiles,
+                                                     const size_t* cells,
+                                                     const size_t& count,
+                                                     const float& evaporation) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 evap = _mm_set1_ps(evaporation);
+    const __m256i local_mask = _mm256_set1_epi64x(tile_cells - 1);
+    const __m256i change_offset =
+        _mm256_set1_epi64x(offsetof(HydraulicTile, water_level_change));
+    alignas(16) float result[4];
+    alignas(32) uintptr_t address[4];
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        // absolute addresses: tile pointer + 4 * local index
+        __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells + k));
+        __m256i tile = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(tiles),
+                                              _mm256_srli_epi64(idx, tile_cell_bits),
+                                              sizeof(HydraulicTile*));
+        __m256i level_address = _mm256_add_epi64(
+            tile, _mm256_slli_epi64(_mm256_and_si256(idx, local_mask), 2));
+        __m256i change_address = _mm256_add_epi64(level_address, change_offset);
+        __m128 l = _mm256_i64gather_ps(nullptr, level_address, 1);
+        __m128 c = _mm256_i64gather_ps(nullptr, change_address, 1);
+        _mm_store_ps(result, _mm_max_ps(_mm_sub_ps(_mm_add_ps(l, c), evap), zero));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(address), level_address);
+        // no scatter in AVX2
+        for (size_t j = 0; j < 4; ++j) {
+            float* level = reinterpret_cast<float*>(address[j]);
+            level[0] = result[j];
+            level[tile_cells] = 0.0f;  // water_level_change
+        }
+    }
+    applySparseScalar(tiles, cells + k, count - k, evaporation);
+}
+#endif
+
+}  // namespace
+
+bool kernelsUseAvx2() {
+#ifdef GBHS_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+void applyDense(float* level,
+                float* change,
+                const size_t& count,
+                const float& evaporation) {
+#ifdef GBHS_X86
+    if (kernelsUseAvx2()) {
+        applyDenseAvx2(level, change, count, evaporation);
+        return;
+    }
+#endif
+    applyDenseScalar(level, change, count, evaporation);
+}
+
+void applySparse(HydraulicTile* const* tiles,
+                 const size_t* cells,
+                 const size_t& count,
+                 const float& evaporation) {
+#ifdef GBHS_X86
+    if (kernelsUseAvx2()) {
+        applySparseAvx2(tiles, cells, count, evaporation);
+        return;
+    }
+#endif
+    applySparseScalar(tiles, cells, count, evaporation);
+}
+
+}  // namespace gbhs
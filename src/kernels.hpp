@@ -0,0 +1,28 @@
+#ifndef EXDIMUM_KERNELS_H
+#define EXDIMUM_KERNELS_H
+
+#include <cstddef>
+
+#include "tiles.hpp"
+
+namespace gbhs {
+
+// level = max(0, level + change - evaporation) and change = 0 for
+// count consecutive cells
+void applyDense(float* level,
+                float* change,
+                const size_t& count,
+                const float& evaporation);
+
+// same as applyDense for the cells (tiled indices) listed in cells
+void applySparse(HydraulicTile* const* tiles,
+                 const size_t* cells,
+                 const size_t& count,
+                 const float& evaporation);
+
+// true if the AVX2 kernels are used on this cpu
+bool kernelsUseAvx2();
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef EXDIMUM_LITTLE_ENDIAN_H
+#define EXDIMUM_LITTLE_ENDIAN_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace gbhs {
+
+// explicit little-endian for file formats, independent of the host
+
+inline void putU32(uint8_t* p, const uint32_t& v) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+inline void putU64(uint8_t* p, const uint64_t& v) {
+    for (int i = 0; i < 8; ++i) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+inline void putF32(uint8_t* p, const float& v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    putU32(p, bits);
+}
+
+inline uint32_t getU32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+inline uint64_t getU64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+inline float getF32(const uint8_t* p) {
+    uint32_t bits = getU32(p);
+    float v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+}  // namespace gbhs
+
+#endif
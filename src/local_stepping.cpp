@@ -0,0 +1,142 @@
+#include "local_stepping.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace gbhs {
+
+LocalStepping::LocalStepping(SimulationData& data, Manning& sim, const size_t& max_level)
+    : data(data), sim(sim), max_level(max_level) {}
+
+float LocalStepping::stableDt() {
+    sim.stableTileDt(tile_stable_dt);
+    float min_dt = *std::min_element(tile_stable_dt.begin(), tile_stable_dt.end());
+    return min_dt * float(size_t(1) << max_level);
+}
+
+void LocalStepping::findLevels(const float& dt) {
+    if (tile_stable_dt.empty()) {
+        sim.stableTileDt(tile_stable_dt);
+    }
+
+    // lowest level with a stable substep, tiles that would need more than max_level
+    // rely on the outflow limit of the step
+    const size_t tile_count = tile_stable_dt.size();
+    tile_level.resize(tile_count);
+    for (size_t t = 0; t < tile_count; ++t) {
+        size_t level = 0;
+        for (float tile_step = dt; tile_step > tile_stable_dt[t] && level < max_level;
+             tile_step *= 0.5f) {
+            ++level;
+        }
+        tile_level[t] = level;
+    }
+
+    // neighbouring tiles differ by one level at most, so a tile never takes more than
+    // two substeps worth of inflow from a faster one
+    const TileGrid& grid = data.tileGrid();
+    smoothed_level.resize(tile_count);
+    for (size_t pass = 0; pass < max_level; ++pass) {
+        bool changed = false;
+        for (size_t ty = 0; ty < grid.tiles_y; ++ty) {
+            for (size_t tx = 0; tx < grid.tiles_x; ++tx) {
+                size_t t = tx + ty * grid.tiles_x;
+                int level = tile_level[t];
+                for (size_t ny = std::max<size_t>(ty, 1) - 1;
+                     ny <= std::min(ty + 1, grid.tiles_y - 1);
+                     ++ny) {
+                    for (size_t nx = std::max<size_t>(tx, 1) - 1;
+                         nx <= std::min(tx + 1, grid.tiles_x - 1);
+                         ++nx) {
+                        level = std::max(level, tile_level[nx + ny * grid.tiles_x] - 1);
+                    }
+                }
+                changed |= level != tile_level[t];
+                smoothed_level[t] = level;
+            }
+        }
+        tile_level.swap(smoothed_level);
+        if (!changed) {
+            break;
+        }
+    }
+}
+
+void LocalStepping::step(const float& dt,
+                         const std::vector<RainSpan>& rain_spans,
+                         const float& rain_weight) {
+    findLevels(dt);
+    tile_stable_dt.clear();
+    const size_t top = *std::max_element(tile_level.begin(), tile_level.end());
+    substep_count = size_t(1) << top;
+
+    // tiles, active cells and rain spans by level
+    level_tiles.resize(max_level + 1);
+    level_cells.resize(max_level + 1);
+    level_spans.resize(max_level + 1);
+    for (size_t level = 0; level <= max_level; ++level) {
+        level_tiles[level].clear();
+        level_cells[level].clear();
+        level_spans[level].clear();
+    }
+    for (size_t t = 0; t < tile_level.size(); ++t) {
+        level_tiles[tile_level[t]].push_back(t);
+    }
+    std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    for (const size_t& cell_idx : cells_with_water) {
+        level_cells[tile_level[cell_idx >> tile_cell_bits]].push_back(cell_idx);
+    }
+    for (size_t level = 1; level <= top; ++level) {
+        for (const RainSpan& span : rain_spans) {
+            size_t tile = data.cellIndex(span.x_begin, span.y) >> tile_cell_bits;
+            if (tile_level[tile] >= level) {
+                level_spans[level].push_back(span);
+            }
+        }
+    }
+
+    // a tile of level l steps every 2^(top - l) substeps, at the last one of each
+    // period, so substep s steps the levels from top - ctz(s) up; dt / 2^l is exact,
+    // the substeps of a tile add up to dt
+    tile_dt.assign(tile_level.size(), 0.f);
+    size_t stepping = top + 1;  // lowest level of the last substep
+    for (size_t substep = 1; substep <= substep_count; ++substep) {
+        const size_t lowest = top - __builtin_ctzll(substep);
+        // only the tiles of the levels that start or stop stepping change
+        for (size_t level = std::min(lowest, stepping);
+             level < std::max(lowest, stepping);
+             ++level) {
+            float level_dt = level >= lowest ? dt / float(size_t(1) << level) : 0.f;
+            for (const size_t& t : level_tiles[level]) {
+                tile_dt[t] = level_dt;
+            }
+        }
+        stepping = lowest;
+
+        // the cells of the levels that step, merged back into index order as far as
+        // the bins are in it; the last substep leaves all of them in the list
+        cells_with_water.clear();
+        for (size_t level = lowest; level <= top; ++level) {
+            size_t middle = cells_with_water.size();
+            cells_with_water.insert(cells_with_water.end(),
+                                    level_cells[level].begin(),
+                                    level_cells[level].end());
+            level_cells[level].clear();
+            std::inplace_merge(cells_with_water.begin(),
+                               cells_with_water.begin() + middle,
+                               cells_with_water.end());
+        }
+        sim.step(tile_dt, lowest == 0 ? rain_spans : level_spans[lowest], rain_weight);
+        if (substep == substep_count) {
+            break;
+        }
+
+        // the cells that are still wet and the ones the substep activated, which
+        // can be in tiles of any level
+        for (const size_t& cell_idx : cells_with_water) {
+            level_cells[tile_level[cell_idx >> tile_cell_bits]].push_back(cell_idx);
+        }
+    }
+}
+
+}  // namespace gbhs
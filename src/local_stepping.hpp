@@ -0,0 +1,54 @@
+#ifndef EXDIMUM_LOCAL_STEPPING_H
+#define EXDIMUM_LOCAL_STEPPING_H
+
+#include <cstdint>
+#include <vector>
+
+#include "manning.hpp"
+#include "rain_field.hpp"
+#include "simulation_data.hpp"
+
+namespace gbhs {
+
+// multi-rate time stepping: every tile takes 2^level substeps of a step, with the
+// lowest level its stable dt allows. inflow across a tile border stays in the level
+// change of the target until that steps, so the exchange is conservative for any mix
+// of levels; every tile steps at the last substep, which leaves no change behind.
+// the tiles, active cells and rain spans are binned by level once per step, a substep
+// only visits the levels that step in it
+class LocalStepping {
+   public:
+    LocalStepping(SimulationData& data, Manning& sim, const size_t& max_level);
+
+    // largest dt [sec] of the next step, the finest tiles take 2^max_level substeps
+    float stableDt();
+    // advances every tile by dt with the levels from the last stableDt()
+    void step(const float& dt,
+              const std::vector<RainSpan>& rain_spans,
+              const float& rain_weight);
+
+    // substeps the last step took
+    size_t substeps() const { return substep_count; }
+
+   private:
+    void findLevels(const float& dt);
+
+    SimulationData& data;
+    Manning& sim;
+    const size_t max_level;
+
+    std::vector<float> tile_stable_dt;  // [sec]
+    std::vector<uint8_t> tile_level;
+    std::vector<uint8_t> smoothed_level;
+    std::vector<float> tile_dt;  // of the current substep, 0 if the tile doesn't step
+    size_t substep_count = 1;
+    // [level] of the current step; the cells of the levels that step are in
+    // cellsWithWater() during a substep instead; spans of the tiles of level and up
+    std::vector<std::vector<size_t>> level_tiles;
+    std::vector<std::vector<size_t>> level_cells;
+    std::vector<std::vector<RainSpan>> level_spans;
+};
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,155 @@
+#include "lz4_block.hpp"
+
+#include <cstring>
+
+namespace gbhs {
+
+namespace {
+
+constexpr size_t min_match = 4;
+constexpr size_t last_literals = 5;  // a block always ends with 5 literals
+constexpr size_t match_safe_distance = 12;  // no match starts in the last 12 bytes
+constexpr size_t max_offset = 65535;
+constexpr size_t hash_bits = 12;
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash(const uint32_t& sequence) {
+    return (sequence * 2654435761u) >> (32 - hash_bits);
+}
+
+uint8_t* writeLength(uint8_t* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+uint8_t* writeSequence(uint8_t* op,
+                       const uint8_t* literals,
+                       const size_t& literal_length,
+                       const size_t& offset,
+                       const size_t& match_length) {
+    uint8_t* token = op++;
+    *token = (uint8_t)((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15) {
+        op = writeLength(op, literal_length - 15);
+    }
+    std::memcpy(op, literals, literal_length);
+    op += literal_length;
+    if (match_length == 0) {
+        return op;  // last sequence
+    }
+
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+    size_t length = match_length - min_match;
+    *token |= (uint8_t)(length >= 15 ? 15 : length);
+    if (length >= 15) {
+        op = writeLength(op, length - 15);
+    }
+    return op;
+}
+
+}  // namespace
+
+size_t lz4Compress(const uint8_t* src, const size_t& n, uint8_t* dst) {
+    uint8_t* op = dst;
+    size_t anchor = 0;
+    if (n > match_safe_distance) {
+        uint32_t table[1 << hash_bits];  // position + 1, 0 is empty
+        std::memset(table, 0, sizeof(table));
+        const size_t match_start_limit = n - match_safe_distance;
+        const size_t match_end_limit = n - last_literals;
+
+        size_t ip = 0;
+        while (ip < match_start_limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t& entry = table[hash(sequence)];
+            size_t ref = entry;
+            entry = ip + 1;
+            if (ref == 0 || ip - (ref - 1) > max_offset ||
+                read32(src + ref - 1) != sequence) {
+                ++ip;
+                continue;
+            }
+
+            ref -= 1;
+            size_t length = min_match;
+            while (ip + length < match_end_limit &&
+                   src[ref + length] == src[ip + length]) {
+                ++length;
+            }
+            op = writeSequence(op, src + anchor, ip - anchor, ip - ref, length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+    op = writeSequence(op, src + anchor, n - anchor, 0, 0);
+    return op - dst;
+}
+
+bool lz4Decompress(const uint8_t* src,
+                   const size_t& n,
+                   uint8_t* dst,
+                   const size_t& raw_size) {
+    const uint8_t* ip = src;
+    const uint8_t* end = src + n;
+    size_t op = 0;
+
+    auto readLength = [&](size_t& length) {
+        uint8_t b = 255;
+        while (b == 255) {
+            if (ip == end) {
+                return false;
+            }
+            b = *ip++;
+            length += b;
+        }
+        return true;
+    };
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !readLength(literal_length)) {
+            return false;
+        }
+        if (literal_length > (size_t)(end - ip) || literal_length > raw_size - op) {
+            return false;
+        }
+        std::memcpy(dst + op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == end) {
+            break;  // last sequence has no match
+        }
+
+        if (end - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !readLength(match_length)) {
+            return false;
+        }
+        match_length += min_match;
+        if (offset == 0 || offset > op || match_length > raw_size - op) {
+            return false;
+        }
+        // byte by byte, the match may overlap the output
+        for (size_t i = 0; i < match_length; ++i, ++op) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op == raw_size;
+}
+
+}  // namespace gbhs
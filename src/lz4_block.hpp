@@ -0,0 +1,27 @@
+#ifndef EXDIMUM_LZ4_BLOCK_H
+#define EXDIMUM_LZ4_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gbhs {
+
+// raw lz4 block format (no frame), so any lz4 block decoder can read the output
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+// greedy single pass compressor with a 4096 entry hash table
+
+// upper bound for the compressed size of n bytes
+inline size_t lz4CompressBound(const size_t& n) { return n + n / 255 + 16; }
+
+// dst needs lz4CompressBound(n) bytes; returns the compressed size
+size_t lz4Compress(const uint8_t* src, const size_t& n, uint8_t* dst);
+
+// false if src isn't a valid block that decompresses to exactly raw_size bytes
+bool lz4Decompress(const uint8_t* src,
+                   const size_t& n,
+                   uint8_t* dst,
+                   const size_t& raw_size);
+
+}  // namespace gbhs
+
+#endif
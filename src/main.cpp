@@ -1,184 +1,307 @@
+#include <algorithm>
 #include <chrono>
-#include <fstream>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 
-#include "gdal_priv.h"
+#include "domain_decomposition.hpp"
+#include "gdal_reader.hpp"
+#include "local_stepping.hpp"
 #include "manning.hpp"
-#include "perlin_noise.hpp"
+#include "output_writer.hpp"
+#include "rain_field.hpp"
+#include "rain_forcing.hpp"
+#include "raster_cache.hpp"
 #include "simulation_data.hpp"
+#include "thread_pool.hpp"
 #include "utils.hpp"
 
 using std::chrono::duration_cast;
 using std::chrono::high_resolution_clock;
 using CHRONO_UNIT = std::chrono::milliseconds;
 
-constexpr size_t simulation_steps = 1500;
-
-void readGDALData(const char* file,
-                  void* buffer,
-                  const int32_t& offset_x,
-                  const int32_t& offset_y,
-                  const int32_t& width,
-                  const int32_t& height) {
-    GDALAllRegister();
-    GDALDataset* dataset = (GDALDataset*)GDALOpen(file, GA_ReadOnly);
-    if (dataset == NULL) {
-        // no compatible driver found
-    }
-
-    GDALRasterBand* band =
-        dataset->GetRasterBand(1);  // assume that there is only one band
-    band->RasterIO(GF_Read,         // mode
-                   offset_x,        // offset x
-                   offset_y,        // offset y
-                   width,           // size x
-                   height,          // size y
-                   buffer,          // buffer
-                   width,           // buffer size x
-                   height,          // buffer size y
-                   GDT_Float32,     // format
-                   0,               // pixel space
-                   0u);             // line space
-    GDALClose(dataset);
-}
-
-// ------------------------------------------------
-
-void addRain(gbhs::SimulationData& data,
-             const std::vector<std::pair<uint32_t, double>>& rain_cells) {
-    for (const auto& i : rain_cells) {
-        data.modifyWaterLevel(i.first, 0.0005f * i.second);
-    }
-}
+constexpr size_t simulation_steps = 1500;  // of settings.dt, also with adaptive dt
+constexpr float output_precision = 0.0001f;  // [m], snapshots round water levels to it
+constexpr size_t output_preallocation = size_t(256) << 20;  // [bytes]
+constexpr char output_file[] = "output/run.gbhs";  // run.<rank>.gbhs with ranks
 
 // ------------------------------------------------
 
-void decideRainCells(std::vector<std::pair<uint32_t, double>>& rain_cells,
-                     gbhs::SimulationData& data,
-                     gbhs::Vec2ui offset) {
-    // decide rain cells
-    rain_cells.clear();
-    const siv::PerlinNoise::seed_type seed = 123456u;
-    const siv::PerlinNoise perlin{seed};
-    for (int y = 0; y < data.dimensions.y; ++y) {
-        for (int x = 0; x < data.dimensions.x; ++x) {
-            float noise = perlin.noise2D_01((double)(x + offset.x) / 4000,
-                                            (double)(y + offset.y) / 4000);
-            if (noise > 0.7f) {
-                size_t idx = x + y * data.dimensions.x;
-                if (data.height_map[idx] < 0.f) {
-                    continue;
-                }
-                rain_cells.push_back({idx, (noise - 0.7) * 3.333});
+int main(int argc, char* argv[]) {
+    std::vector<const char*> args;
+    const char* rainpath = nullptr;
+    bool adaptive_dt = false;
+    bool local_dt = false;
+    bool multi_flow = false;
+    gbhs::GridMemory memory;
+    size_t steal_grain = 1;
+    size_t ranks = 1;
+    long rank = -1;
+    std::vector<std::string> peers;
+    std::vector<long> window;  // x, y, width, height
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--rain" && i + 1 < argc) {
+            rainpath = argv[++i];
+        } else if (std::string(argv[i]) == "--adaptive-dt") {
+            adaptive_dt = true;
+        } else if (std::string(argv[i]) == "--local-dt") {
+            adaptive_dt = true;
+            local_dt = true;
+        } else if (std::string(argv[i]) == "--window" && i + 4 < argc) {
+            for (int k = 0; k < 4; ++k) {
+                window.push_back(std::atol(argv[++i]));
+            }
+        } else if (std::string(argv[i]) == "--mfd") {
+            multi_flow = true;
+        } else if (std::string(argv[i]) == "--huge-pages") {
+            memory.huge_pages = true;
+        } else if (std::string(argv[i]) == "--interleave") {
+            memory.numa_policy = gbhs::NumaPolicy::interleave;
+        } else if (std::string(argv[i]) == "--steal-grain" && i + 1 < argc) {
+            steal_grain = std::max(1l, std::atol(argv[++i]));
+        } else if (std::string(argv[i]) == "--ranks" && i + 1 < argc) {
+            ranks = std::max(1l, std::atol(argv[++i]));
+        } else if (std::string(argv[i]) == "--rank" && i + 2 < argc) {
+            // --rank <r> <host:port of rank 0>,<of rank 1>,...
+            rank = std::atol(argv[++i]);
+            std::stringstream list(argv[++i]);
+            for (std::string peer; std::getline(list, peer, ',');) {
+                peers.push_back(peer);
             }
+        } else {
+            args.push_back(argv[i]);
         }
     }
-}
-
-// ------------------------------------------------
-
-void writeMetadata(const gbhs::SimulationSettings& settings, gbhs::SimulationData& data) {
-    // print map
-    const char* filename = "output/metadata.bin";
-    std::ofstream ws(filename, std::ios::binary);
-    if (!ws.is_open()) {
-        std::cout << "Error opening the file '" << filename << "'!" << std::endl;
-        exit(1);
-    }
-    ws.write(reinterpret_cast<const char*>(&settings), sizeof(gbhs::SimulationSettings));
-    ws.write(reinterpret_cast<const char*>(data.height_map.ptr()),
-             sizeof(float) * data.height_map.size());
-    ws.close();
-}
-
-// ------------------------------------------------
-
-void writeStepData(const std::string& filename,
-                   const uint32_t& size,
-                   const std::vector<std::pair<uint32_t, float>>& data) {
-    std::ofstream ws(filename, std::ios::binary);
-    if (!ws.is_open()) {
-        std::cout << "Error opening the file '" << filename << "'!" << std::endl;
-        std::exit(1);
-    }
-    ws.write(reinterpret_cast<const char*>(&size), sizeof(uint32_t));
-    ws.write(reinterpret_cast<const char*>(&data[0]),
-             sizeof(std::pair<uint32_t, float>) * size);
-    ws.close();
-}
-
-// ------------------------------------------------
-
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    if (args.size() != 1 && args.size() != 2) {
         std::cout << "A mandatory file path to the geo dataset is missing." << std::endl;
+        std::cout << "usage: gbhs <geo dataset> [raster cache] [--rain <forcing list>] "
+                     "[--window <x> <y> <width> <height>] "
+                     "[--adaptive-dt | --local-dt] [--mfd] [--huge-pages] "
+                     "[--interleave] [--steal-grain <n>] "
+                     "[--ranks <n> | --rank <r> <host:port list>]"
+                  << std::endl;
+        return 1;
+    }
+    if (!window.empty() &&
+        (window[0] < 0 || window[1] < 0 || window[2] < 1 || window[3] < 1)) {
+        std::cout << "The window has to be inside the geo dataset!" << std::endl;
         return 1;
     }
 
+    // distributed runs, see domain_decomposition.hpp; the processes have to exist
+    // before any thread does
+    gbhs::RankLinks links;
+    if ((ranks > 1 && !gbhs::spawnLocalRanks(ranks, links)) ||
+        (rank >= 0 && !gbhs::connectRanks(rank, peers, links))) {
+        std::cout << "Error connecting the ranks!" << std::endl;
+        return 1;
+    }
+    const bool distributed = links.ranks > 1;
+
     // prepare simulation
-    const char* filepath = argv[1];
+    const char* filepath = args[0];
+    std::string cachepath = args.size() == 2 ? args[1] : "";
+    std::string output_path = output_file;
     gbhs::SimulationSettings settings;
-    gbhs::SimulationData data(settings.width, settings.height);
-    readGDALData(filepath,
-                 data.height_map.ptr(),
-                 settings.offset_x,
-                 settings.offset_y,
-                 settings.width,
-                 settings.height);
-    data.findNeighbours();
-    gbhs::Manning sim(data);
-    std::vector<std::pair<uint32_t, float>> output_data;
-    writeMetadata(settings, data);
-
-    // add initial rain
-    std::vector<std::pair<uint32_t, double>> rain_cells;
-    decideRainCells(rain_cells, data, {0, 0});
-    addRain(data, rain_cells);
+    if (!window.empty()) {
+        settings.offset_x = window[0];
+        settings.offset_y = window[1];
+        settings.width = window[2];
+        settings.height = window[3];
+    }
+    settings.adaptive_dt = adaptive_dt;
+    settings.local_dt = local_dt;
+    settings.multi_flow = multi_flow;
+    settings.memory = memory;
+    settings.steal_grain = steal_grain;
+    gbhs::Subdomain domain;
+    if (distributed) {
+        if (!gbhs::partition(settings, links.rank, links.ranks, domain)) {
+            std::cout << "More ranks than rows!" << std::endl;
+            return 1;
+        }
+        // filling a strip alone would drain its depressions across the strip borders
+        settings.fill_depressions = false;
+        std::string suffix = "." + std::to_string(links.rank);
+        cachepath += cachepath.empty() ? "" : suffix;
+        output_path.insert(output_path.rfind('.'), suffix);
+    }
+    // local ranks share the cores
+    gbhs::ThreadPool pool(
+        std::max<size_t>(1,
+                         std::thread::hardware_concurrency() /
+                             (links.children.empty() ? 1 : links.ranks)));
+    if (!gbhs::SimulationData::fits(settings.width, settings.height)) {
+        std::cout << "The window is too large, at most 2^31 cells are supported!"
+                  << std::endl;
+        return 1;
+    }
+    gbhs::SimulationData data(settings.width, settings.height, settings.memory);
+    if (!cachepath.empty() &&
+        gbhs::readRasterCache(cachepath.c_str(), filepath, settings, data)) {
+        std::cout << "Using the raster cache '" << cachepath << "'." << std::endl;
+    } else {
+        if (!gbhs::loadHeightMap(filepath, settings, data, pool)) {
+            std::cout << "Error reading the geo dataset '" << filepath << "'!"
+                      << std::endl;
+            return 1;
+        }
+        if (!cachepath.empty() &&
+            !gbhs::writeRasterCache(cachepath.c_str(), filepath, settings, data)) {
+            std::cout << "Error writing the raster cache '" << cachepath << "'!"
+                      << std::endl;
+        }
+    }
+    if (settings.multi_flow) {
+        data.findFlowWeights(pool);
+    }
+    gbhs::Manning sim(data, pool);
+    sim.setStealGrain(settings.steal_grain);
+    std::unique_ptr<gbhs::LocalStepping> local_stepping;
+    if (settings.local_dt) {
+        local_stepping =
+            std::make_unique<gbhs::LocalStepping>(data, sim, settings.max_local_level);
+    }
+    std::unique_ptr<gbhs::HaloExchange> halo;
+    if (distributed) {
+        halo = std::make_unique<gbhs::HaloExchange>(data, sim, domain, links);
+    }
+    gbhs::OutputWriter output(pool, data.dimensions, output_precision);
+    if (!output.open(output_path.c_str(), output_preallocation) ||
+        !output.writeMetadata(settings, data)) {
+        std::cout << "Error writing the file '" << output_path << "'!" << std::endl;
+        return 1;
+    }
+
+    // rain from the forcing if there is one, otherwise synthetic
+    std::unique_ptr<gbhs::RainForcing> forcing;
+    std::unique_ptr<gbhs::RainField> rain_field;
+    std::vector<gbhs::RainSpan> rain_spans;
+    std::vector<gbhs::RainSpan> owned_spans;  // without the halo rows
+    // a strip samples the rain at its place in the window, on the lattice of the window
+    const uint32_t rain_row = domain.row_begin - domain.halo_top;
+    if (rainpath != nullptr) {
+        forcing = std::make_unique<gbhs::RainForcing>(data, pool, rain_row);
+        if (!forcing->open(rainpath, filepath, settings)) {
+            std::cout << "Error reading the rain forcing '" << rainpath << "'!"
+                      << std::endl;
+            return 1;
+        }
+    } else {
+        rain_field = std::make_unique<gbhs::RainField>(data, pool, rain_row);
+        rain_field->decide(rain_spans, {0, rain_row});
+    }
 
     // run simulation
     auto t_start = high_resolution_clock::now();
     auto t_step_start = high_resolution_clock::now();
-    size_t output_counter = settings.output_resolution;  // [steps]
-    for (size_t i = 0; i < simulation_steps; ++i) {
-        sim.step(settings.dt);
-        addRain(data, rain_cells);
+    // output is scheduled in simulated time, half a step early at most
+    const double end_time = simulation_steps * settings.dt;                 // [s]
+    const double output_interval = settings.output_resolution * settings.dt;  // [s]
+    double next_output = output_interval;
+    size_t output_count = 0;
+    double time = 0.0;  // [s] simulated
+    for (size_t i = 0; time < end_time - 0.5 * settings.dt; ++i) {
+        // adaptive steps end right at the next output
+        float dt = settings.dt;
+        bool at_output = false;
+        if (settings.adaptive_dt) {
+            float stable_dt =
+                local_stepping ? local_stepping->stableDt() : sim.stableDt();
+            if (halo && !halo->allMin(stable_dt)) {
+                std::cout << "Error exchanging with the ranks!" << std::endl;
+                return 1;
+            }
+            dt = std::min(stable_dt, settings.max_dt);
+            if (time + dt >= next_output) {
+                dt = next_output - time;
+                at_output = true;
+            }
+        }
 
-        // debug info
+        // rain of the step is the rate at its end
+        const std::vector<gbhs::RainSpan>* step_rain = &rain_spans;
+        float rain_weight = 0.f;
+        if (forcing) {
+            forcing->update(time + dt);
+            if (!forcing->good()) {
+                std::cout << "Error reading the rain frame '" << forcing->failedFile()
+                          << "'!" << std::endl;
+                return 1;
+            }
+            step_rain = &forcing->spans();
+            rain_weight = forcing->weight();
+        }
+        if (halo) {
+            halo->ownedSpans(*step_rain, owned_spans);
+            step_rain = &owned_spans;
+        }
+        if (local_stepping) {
+            local_stepping->step(dt, *step_rain, rain_weight);
+        } else {
+            sim.step(dt, *step_rain, rain_weight);
+        }
+        // outflow across the strip borders
+        if (halo && !halo->finishStep()) {
+            std::cout << "Error exchanging with the ranks!" << std::endl;
+            return 1;
+        }
+        time = at_output ? next_output : time + dt;
+
+        // debug info, of the first rank only
         auto t_step =
             duration_cast<CHRONO_UNIT>(high_resolution_clock::now() - t_step_start);
         t_step_start = high_resolution_clock::now();
         float fps = 1000.f / t_step.count();  // TODO avoid constant
-        std::cout << "step " << i << ": " << fps << "fps; "
-                  << data.cellsWithWater().size() << " cells with water" << std::endl;
-
-        // sweep empty cells & output
-        if (--output_counter == 0) {
-            output_counter = settings.output_resolution;
-            std::cout << "------" << std::endl;
-
-            // prepare water level data for output
-            data.sweepCellsWithWater();
-            size_t output_size = data.cellsWithWater().size();
-            output_data.reserve(output_size);
-            for (const uint32_t& idx : data.cellsWithWater()) {
-                output_data.push_back({idx, data.getCell(idx).water_level});
+        if (links.rank == 0) {
+            std::cout << "step " << i << ": " << fps << "fps; dt " << dt << "s";
+            if (local_stepping) {
+                std::cout << " in " << local_stepping->substeps() << " substeps";
+            }
+            std::cout << "; " << data.cellsWithWater().size() << " cells with water"
+                      << std::endl;
+        }
+
+        // output
+        if (time >= next_output - 0.5 * settings.dt) {
+            next_output += output_interval;
+            if (links.rank == 0) {
+                std::cout << "------" << std::endl;
             }
 
-            // save water levels to disk
-            std::string filename = "output/step_";
-            uint32_t step_count = (int)(i / settings.output_resolution);
-            filename.append(std::to_string(step_count));
-            filename.append(".bin");
-            writeStepData(filename, output_size, output_data);
-            output_data.clear();
+            // save water levels to disk, written in the background; the step of the
+            // output is the simulated time in multiples of settings.dt
+            uint64_t output_step = std::llround(time / settings.dt);
+            if (!output.writeStep(output_step, data)) {
+                std::cout << "Error writing the file '" << output_path << "'!"
+                          << std::endl;
+                return 1;
+            }
 
-            // change rain
-            decideRainCells(rain_cells, data, {step_count * 250, step_count * 250});
+            // change synthetic rain
+            uint32_t step_count = output_count++;
+            if (rain_field) {
+                rain_field->decide(rain_spans,
+                                   {step_count * 250, step_count * 250 + rain_row});
+            }
         }
     }
 
+    if (!output.close()) {
+        std::cout << "Error writing the file '" << output_path << "'!" << std::endl;
+        return 1;
+    }
+
+    if (!gbhs::closeRanks(links)) {
+        std::cout << "A rank failed!" << std::endl;
+        return 1;
+    }
+
     // runtime measurements
     auto t_end = high_resolution_clock::now();
     auto t_diff = duration_cast<CHRONO_UNIT>(t_end - t_start);
@@ -2,85 +2,508 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "fast_math.hpp"
+#include "kernels.hpp"
 
 namespace gbhs {
 
-/* void Manning::fillDepressions() {
-    // "fill_depressions"
-    std::sort(data.cellsWithWater().begin(),
-              data.cellsWithWater().end(),
-              [&](const size_t& idx_1, const size_t& idx_2) {
-                  return data.height_map[idx_1] < data.height_map[idx_2];
-              });
-
-    for (const size_t& cell_idx : data.cellsWithWater()) {
-        const Cell& c = data.getCell(cell_idx);
-        float cell_height = data.height_map[cell_idx];
-
-        for (size_t i = 0; i < c.higher_neigbours.size(); ++i) {
-            const Cell& neighbor = data.getCell(c.higher_neigbours[i]);
-            float neighbor_height = data.height_map[c.higher_neigbours[i]];
-            if (cell_height + c.water_level <= neighbor_height) {
-                break;
+namespace {
+
+// TODO constants for now
+constexpr float channel_width = 0.5f;  // w
+constexpr float roughness = 0.035f;    // r
+constexpr float evaporation_rate = 0.001f;  // [m/s]
+
+}  // namespace
+
+Manning::Manning(SimulationData& data, ThreadPool& pool)
+    : data(data), pool(&pool), scheduler(std::make_unique<TileScheduler>(pool)) {
+    // owners are whole tiles, so that no two of them share a word of the active
+    // bitset or allocate the water state of the same tile
+    const size_t tile_count = data.cellCount() >> tile_cell_bits;
+    owner_count = std::min(tile_count, pool.size() * owners_per_thread);
+    owner_tiles.resize(owner_count + 1);
+    tile_owners.resize(tile_count);
+    owner_weights.resize(owner_count);
+    inflows.resize(pool.size(), std::vector<std::vector<Inflow>>(owner_count));
+    activated.resize(owner_count);
+    wet_ranges.resize(pool.size());
+    outflow_rates.resize(pool.size());
+}
+
+void Manning::step(const float& dt) { step(dt, {}, 0.f); }
+
+void Manning::step(const float& dt,
+                   const std::vector<RainSpan>& rain_spans,
+                   const float& rain_weight) {
+    if (pool == nullptr || pool->size() == 1) {
+        stepSerial(dt, nullptr, rain_spans, rain_weight);
+    } else {
+        stepParallel(dt, nullptr, rain_spans, rain_weight);
+    }
+}
+
+void Manning::step(const std::vector<float>& tile_dt,
+                   const std::vector<RainSpan>& rain_spans,
+                   const float& rain_weight) {
+    if (pool == nullptr || pool->size() == 1) {
+        stepSerial(0.f, tile_dt.data(), rain_spans, rain_weight);
+    } else {
+        stepParallel(0.f, tile_dt.data(), rain_spans, rain_weight);
+    }
+}
+
+float Manning::stableDt() {
+    // cellOutflow is (dt / r) * h * rate, so dt <= courant * r / rate for the highest
+    // rate
+    const std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    std::fill(outflow_rates.begin(), outflow_rates.end(), 0.f);
+    parallelFor(cells_with_water.size(), [&](size_t begin,
+                                             size_t end,
+                                             size_t thread_idx) {
+        float max_rate = 0.f;
+        for (size_t k = begin; k < end; ++k) {
+            max_rate = std::max(max_rate, outflowRate(cells_with_water[k]));
+        }
+        outflow_rates[thread_idx] = max_rate;
+    });
+    float max_rate = *std::max_element(outflow_rates.begin(), outflow_rates.end());
+    if (max_rate <= 0.f) {
+        return std::numeric_limits<float>::infinity();
+    }
+    return courant * roughness / max_rate;
+}
+
+void Manning::stableTileDt(std::vector<float>& tile_dt) {
+    // highest rate per tile; the rates are not negative, so their bits order like
+    // unsigned integers and a compare exchange keeps the maximum
+    const std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    tile_rates.assign(data.cellCount() >> tile_cell_bits, 0);
+    parallelFor(cells_with_water.size(), [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k) {
+            size_t cell_idx = cells_with_water[k];
+            float rate = outflowRate(cell_idx);
+            uint32_t bits;
+            std::memcpy(&bits, &rate, sizeof(float));
+            uint32_t* tile_rate = &tile_rates[cell_idx >> tile_cell_bits];
+            uint32_t current = __atomic_load_n(tile_rate, __ATOMIC_RELAXED);
+            while (bits > current && !__atomic_compare_exchange_n(tile_rate,
+                                                                  &current,
+                                                                  bits,
+                                                                  true,
+                                                                  __ATOMIC_RELAXED,
+                                                                  __ATOMIC_RELAXED)) {
             }
+        }
+    });
+
+    tile_dt.resize(tile_rates.size());
+    for (size_t t = 0; t < tile_rates.size(); ++t) {
+        float rate;
+        std::memcpy(&rate, &tile_rates[t], sizeof(float));
+        tile_dt[t] = rate > 0.f ? courant * roughness / rate
+                                : std::numeric_limits<float>::infinity();
+    }
+}
+
+void Manning::setStealGrain(const size_t& grain) {
+    if (scheduler) {
+        scheduler->setStealGrain(grain);
+    }
+}
 
-            // fill neighbor
-            float level_balance =
-                (cell_height + c.water_level - neighbor_height) / (2 + i);
+void Manning::setOutlets(const std::vector<size_t>& cells) {
+    outlets = cells;
+    outlet_inflow.assign(cells.size(), 0.f);
+}
+
+float Manning::outflowRate(const size_t& cell_idx) const {
+    float h = data.waterLevel(cell_idx);
+    return data.flowCoefficient(cell_idx) *
+           fastPow2_3((channel_width * h) / (channel_width + 2.f * h));
+}
+
+float Manning::cellOutflow(const size_t& cell_idx, const float& dt) const {
+    const float w = channel_width;
+    const float r = roughness;
+
+    // (dt / l) * h * (1 / r) * ((w * h) / (w + 2 * h))^(2/3) * sqrt(s) with the
+    // per cell sqrt(s) / l from findNeighbours
+    float h = data.waterLevel(cell_idx);
+    float outflow = (dt * (1.f / r)) * data.flowCoefficient(cell_idx) * h *
+                    fastPow2_3((w * h) / (w + 2.f * h));
+    if (outflow > h) {
+        outflow = h;
+    }
+    return outflow;
+}
+
+template <typename Fn>
+void Manning::scatter(const size_t& cell_idx,
+                      const int32_t& neighbor,
+                      const float& amount,
+                      const Fn& fn) const {
+    if (!data.multiFlow()) {
+        fn(neighbor, amount, 0);
+        return;
+    }
+
+    // the last share takes what is left, so rounding doesn't lose any water
+    uint64_t weights = data.flowWeights(cell_idx);
+    const size_t last = (63 - __builtin_clzll(weights)) >> 3;
+    float rest = amount;
+    while (weights != 0) {
+        size_t d = __builtin_ctzll(weights) >> 3;
+        float share = (weights >> (8 * d)) & 0xff;
+        weights &= ~(uint64_t(0xff) << (8 * d));
+        float part = d == last ? rest : amount * (share * (1.f / 255.f));
+        rest -= part;
+        fn(data.neighbourIndex(cell_idx, d), part, d);
+    }
+}
+
+static_assert(rain_lattice == tile_size && tile_size == 64,
+              "a rain span has to lie inside one word of the active bitset");
+
+uint64_t Manning::addRain(const RainSpan& span,
+                          const size_t& row_idx,
+                          const float& rain_weight,
+                          const float& dt) {
+    const size_t begin = span.x_begin % tile_size;
+    const size_t end = begin + (span.x_end - span.x_begin);
+    float amount[tile_size];
+    uint64_t mask = 0;
+    for (size_t i = begin; i < end; ++i) {
+        float rate = rainRate(span, span.x_begin + (i - begin), rain_weight);
+        mask |= uint64_t(rate > 0.f) << i;
+        amount[i] = std::max(0.f, rate) * dt;
+    }
+    if (mask == 0) {
+        return 0;
+    }
+
+    // cells without rain get + 0
+    uint64_t new_cells = data.activateRow(row_idx, mask);
+    float* change = &data.waterLevelChange(row_idx);
+    for (size_t i = begin; i < end; ++i) {
+        change[i] += amount[i];
+    }
+    return new_cells;
+}
+
+void Manning::stepSerial(const float& dt,
+                         const float* tile_dt,
+                         const std::vector<RainSpan>& rain_spans,
+                         const float& rain_weight) {
+    std::vector<size_t>& cells_with_water = data.cellsWithWater();
+
+    // in- and outflow; cells activated in here are only part of the apply phase
+    const size_t cell_count = cells_with_water.size();
+    for (size_t k = 0; k < cell_count; ++k) {
+        size_t cell_idx = cells_with_water[k];
+        int32_t neighbor = data.neighbor(cell_idx);
+        float cell_dt = tile_dt == nullptr ? dt : tile_dt[cell_idx >> tile_cell_bits];
+
+        if (neighbor >= 0 && cell_dt > 0.f) {
+            float amount = cellOutflow(cell_idx, cell_dt);
+            data.waterLevel(cell_idx) -= amount;
+            scatter(cell_idx, neighbor, amount, [&](size_t target, float part, size_t) {
+                if (data.activate(target)) {
+                    cells_with_water.push_back(target);
+                }
+                data.waterLevelChange(target) += part;
+            });
+        }
+    }
 
-            // select the next highest neighbor
-            if (i + 1 < c.higher_neigbours.size()) {
-                float next_neighbor_height = data.height_map[c.higher_neigbours[i + 1]];
-                level_balance =
-                    std::min(level_balance, next_neighbor_height - neighbor_height);
+    appended_cells += cells_with_water.size() - cell_count;
+
+    // rain goes into the level changes as well, so that one apply sweep integrates
+    // rain, inflow and evaporation
+    for (const RainSpan& span : rain_spans) {
+        size_t row_idx = data.cellIndex(span.x_begin - span.x_begin % tile_size, span.y);
+        float span_dt = tile_dt == nullptr ? dt : tile_dt[row_idx >> tile_cell_bits];
+        if (span_dt <= 0.f) {
+            continue;
+        }
+        for (uint64_t new_cells = addRain(span, row_idx, rain_weight, span_dt);
+             new_cells != 0;
+             new_cells &= new_cells - 1) {
+            cells_with_water.push_back(row_idx + __builtin_ctzll(new_cells));
+        }
+    }
+
+    apply(dt, tile_dt);
+    orderCells();
+}
+
+void Manning::stepParallel(const float& dt,
+                           const float* tile_dt,
+                           const std::vector<RainSpan>& rain_spans,
+                           const float& rain_weight) {
+    std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    partitionOwners();
+
+    // outflow of every cell, scatter is buffered per thread and target owner
+    const size_t cell_count = cells_with_water.size();
+    pool->parallelFor(cell_count, [&](size_t begin, size_t end, size_t thread_idx) {
+        std::vector<std::vector<Inflow>>& buffers = inflows[thread_idx];
+        for (size_t k = begin; k < end; ++k) {
+            size_t cell_idx = cells_with_water[k];
+            int32_t neighbor = data.neighbor(cell_idx);
+            float cell_dt =
+                tile_dt == nullptr ? dt : tile_dt[cell_idx >> tile_cell_bits];
+            if (neighbor >= 0 && cell_dt > 0.f) {
+                float amount = cellOutflow(cell_idx, cell_dt);
+                data.waterLevel(cell_idx) -= amount;
+                scatter(cell_idx,
+                        neighbor,
+                        amount,
+                        [&](size_t target, float part, size_t d) {
+                            buffers[ownerOf(target)].push_back(
+                                {target, k * 8 + d, part});
+                        });
             }
+        }
+    });
+
+    // the measured work of every owner decides the runs of the threads, the rest is
+    // balanced by stealing owners
+    std::fill(owner_weights.begin(), owner_weights.end(), 0);
+    for (const std::vector<std::vector<Inflow>>& buffers : inflows) {
+        for (size_t owner = 0; owner < owner_count; ++owner) {
+            owner_weights[owner] += buffers[owner].size();
+        }
+    }
+    for (const RainSpan& span : rain_spans) {
+        owner_weights[ownerOf(data.cellIndex(span.x_begin, span.y))] += tile_size;
+    }
 
-            data.modifyWaterLevel(cell_idx, -level_balance * (1 + i));
+    // every owner gathers its inflows in list order, which keeps the summation
+    // order of the serial step, and then the rain of its cells
+    scheduler->run(owner_weights, [&](size_t owner, size_t) {
+        activated[owner].clear();
+        for (std::vector<std::vector<Inflow>>& buffers : inflows) {
+            for (const Inflow& inflow : buffers[owner]) {
+                if (data.activate(inflow.target)) {
+                    activated[owner].push_back({inflow.order, inflow.target});
+                }
+                data.waterLevelChange(inflow.target) += inflow.amount;
+            }
+            buffers[owner].clear();
+        }
 
-            for (size_t m = 0; m < i + 1; ++m) {
-                data.modifyWaterLevel(c.higher_neigbours[m], level_balance);
+        // the owner covers the tile rows of its first to its last tile; rain
+        // activations sort behind the inflows in span order
+        if (owner_tiles[owner] == owner_tiles[owner + 1]) {
+            return;
+        }
+        uint32_t y_begin = data.cellCoords(owner_tiles[owner] << tile_cell_bits).y;
+        uint32_t y_end =
+            data.cellCoords((owner_tiles[owner + 1] << tile_cell_bits) - 1).y + 1;
+        auto first = std::lower_bound(
+            rain_spans.begin(),
+            rain_spans.end(),
+            y_begin,
+            [](const RainSpan& span, const uint32_t& y) { return span.y < y; });
+        for (auto span = first; span != rain_spans.end() && span->y < y_end; ++span) {
+            size_t row_idx =
+                data.cellIndex(span->x_begin - span->x_begin % tile_size, span->y);
+            float span_dt = tile_dt == nullptr ? dt : tile_dt[row_idx >> tile_cell_bits];
+            if (ownerOf(row_idx) != owner || span_dt <= 0.f) {
+                continue;
+            }
+            size_t pos = cell_count * 8 + (span - rain_spans.begin()) * tile_size;
+            for (uint64_t new_cells = addRain(*span, row_idx, rain_weight, span_dt);
+                 new_cells != 0;
+                 new_cells &= new_cells - 1) {
+                size_t i = __builtin_ctzll(new_cells);
+                activated[owner].push_back({pos + i, row_idx + i});
             }
         }
+    });
+
+    // append activated cells in the order the serial step would find them; every
+    // owner found its cells in that order, so merging the owners' lists is enough
+    std::vector<std::pair<size_t, size_t>> new_cells;
+    std::vector<size_t> runs = {0};
+    for (const std::vector<std::pair<size_t, size_t>>& cells : activated) {
+        new_cells.insert(new_cells.end(), cells.begin(), cells.end());
+        runs.push_back(new_cells.size());
+    }
+    const size_t run_count = runs.size() - 1;
+    for (size_t width = 1; width < run_count; width *= 2) {
+        for (size_t r = 0; r + width < run_count; r += 2 * width) {
+            size_t end = runs[std::min(r + 2 * width, run_count)];
+            std::inplace_merge(new_cells.begin() + runs[r],
+                               new_cells.begin() + runs[r + width],
+                               new_cells.begin() + end);
+        }
+    }
+    for (const std::pair<size_t, size_t>& cell : new_cells) {
+        cells_with_water.push_back(cell.second);
+        appended_cells += cell.first < cell_count * 8;
     }
-} */
 
-void Manning::step(const float& dt) {
-    // TODO constants for now
-    float w = 0.5f;
-    float r = 0.035f;
+    apply(dt, tile_dt);
+    orderCells();
+}
 
-    // in- and outflow
-    for (const size_t& cell_idx : data.cellsWithWater()) {
-        Cell& c = data.getCell(cell_idx);
+void Manning::partitionOwners() {
+    // the list is close to index order, so its quantiles split the wet cells about
+    // evenly; bounds out of order from the unsorted tail are sorted, owners may be
+    // empty
+    const std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    const size_t n = cells_with_water.size();
+    owner_tiles.front() = 0;
+    owner_tiles.back() = data.cellCount() >> tile_cell_bits;
+    for (size_t owner = 1; owner < owner_count; ++owner) {
+        owner_tiles[owner] =
+            n == 0 ? owner_tiles.back()
+                   : cells_with_water[owner * n / owner_count] >> tile_cell_bits;
+    }
+    std::sort(owner_tiles.begin() + 1, owner_tiles.end() - 1);
+    for (size_t owner = 0; owner < owner_count; ++owner) {
+        std::fill(tile_owners.begin() + owner_tiles[owner],
+                  tile_owners.begin() + owner_tiles[owner + 1],
+                  owner);
+    }
+}
+
+void Manning::apply(const float& dt, const float* tile_dt) {
+    drainOutlets();
+    if (tile_dt != nullptr) {
+        applyTiles(tile_dt);
+        return;
+    }
+    if (outlet_exchange) {
+        outlet_exchange();
+    }
+
+    // apply in-/outflow & removing negative water levels
+    // cells outside of cellsWithWater() have neither water nor a level change, so
+    // once enough of the wet tiles is covered a dense sweep beats gathering the list
+    std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    HydraulicTile* const* tiles = data.hydraulicTiles();
+    const std::vector<size_t>& wet_tiles = data.wetTiles();
+    const float evaporation = evaporation_rate * dt;
+    bool dense =
+        cells_with_water.size() * dense_apply_ratio >= wet_tiles.size() * tile_cells;
+    if (dense) {
+        parallelFor(wet_tiles.size(), [&](size_t begin, size_t end, size_t) {
+            for (size_t t = begin; t < end; ++t) {
+                HydraulicTile* tile = tiles[wet_tiles[t]];
+                applyDense(
+                    tile->water_level, tile->water_level_change, tile_cells, evaporation);
+            }
+        });
+    }
 
-        if (c.neighbor >= 0) {
-            // calc flow
-            float s = abs(data.cellGradient(c.neighbor, cell_idx));
-            float h = c.water_level;
-            float l = data.cellDistance(cell_idx, c.neighbor);
-            float outflow = (dt / (l * w)) * w * h * (1.f / r) *
-                            powf((w * h) / (w + 2.f * h), 2.f / 3.f) * sqrtf(s);
-            if (outflow > h) {
-                outflow = h;
+    // drop cells that ran dry, every chunk of the list is compacted in place
+    std::fill(wet_ranges.begin(), wet_ranges.end(), std::make_pair(0, 0));
+    parallelFor(cells_with_water.size(), [&](size_t begin,
+                                             size_t end,
+                                             size_t thread_idx) {
+        if (!dense) {
+            applySparse(tiles, &cells_with_water[begin], end - begin, evaporation);
+        }
+        size_t wet_end = begin;
+        for (size_t k = begin; k < end; ++k) {
+            size_t cell_idx = cells_with_water[k];
+            if (data.waterLevel(cell_idx) > 0.f) {
+                cells_with_water[wet_end++] = cell_idx;
+            } else {
+                data.deactivate(cell_idx);
             }
-            c.water_level -= outflow;
-            Cell& neighbor = data.getCell(c.neighbor);
-            neighbor.water_level_change += outflow;
-            if (!neighbor.active) {
-                neighbor.active = true;
-                data.cellsWithWater().push_back(c.neighbor);  // TODO danger
+        }
+        wet_ranges[thread_idx] = {begin, wet_end};
+    });
+    joinWetRanges();
+}
+
+void Manning::applyTiles(const float* tile_dt) {
+    // as apply, but cells of tiles that don't step keep their level and change
+    std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    std::fill(wet_ranges.begin(), wet_ranges.end(), std::make_pair(0, 0));
+    parallelFor(cells_with_water.size(), [&](size_t begin,
+                                             size_t end,
+                                             size_t thread_idx) {
+        size_t wet_end = begin;
+        for (size_t k = begin; k < end; ++k) {
+            size_t cell_idx = cells_with_water[k];
+            float cell_dt = tile_dt[cell_idx >> tile_cell_bits];
+            if (cell_dt > 0.f) {
+                float& level = data.waterLevel(cell_idx);
+                float& change = data.waterLevelChange(cell_idx);
+                level = std::max(0.f, level + change - evaporation_rate * cell_dt);
+                change = 0.f;
+                if (!(level > 0.f)) {
+                    data.deactivate(cell_idx);
+                    continue;
+                }
             }
+            cells_with_water[wet_end++] = cell_idx;
         }
+        wet_ranges[thread_idx] = {begin, wet_end};
+    });
+    joinWetRanges();
+}
+
+void Manning::drainOutlets() {
+    // drained outlets are dry, so apply drops them
+    for (size_t i = 0; i < outlets.size(); ++i) {
+        size_t cell_idx = outlets[i];
+        if (!data.isActive(cell_idx)) {
+            continue;
+        }
+        float& level = data.waterLevel(cell_idx);
+        float& change = data.waterLevelChange(cell_idx);
+        outlet_inflow[i] += level + change;
+        level = 0.f;
+        change = 0.f;
     }
+}
 
-    // apply in-/outflow & removing negative water levels
-    for (const size_t& cell_idx : data.cellsWithWater()) {
-        Cell& c = data.getCell(cell_idx);
-        c.water_level = std::max(0.f, c.water_level + c.water_level_change - 0.001f * dt);
-        c.water_level_change = 0.0f;
+void Manning::joinWetRanges() {
+    // join the compacted chunks, their order stays the same
+    std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    size_t wet_count = 0;
+    for (const std::pair<size_t, size_t>& range : wet_ranges) {
+        std::copy(cells_with_water.begin() + range.first,
+                  cells_with_water.begin() + range.second,
+                  cells_with_water.begin() + wet_count);
+        wet_count += range.second - range.first;
     }
+    cells_with_water.resize(wet_count);
+}
 
-    // fillDepressions();
+void Manning::orderCells() {
+    // cells activated by inflow are appended in the order they were reached, which
+    // scatters the list over the tiles; back to storage order once enough was
+    // appended. rain appends whole tile rows at a time and isn't counted
+    std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    if (appended_cells * reorder_ratio < cells_with_water.size()) {
+        return;
+    }
+    appended_cells = 0;
+    auto unsorted =
+        std::is_sorted_until(cells_with_water.begin(), cells_with_water.end());
+    std::sort(unsorted, cells_with_water.end());
+    std::inplace_merge(cells_with_water.begin(), unsorted, cells_with_water.end());
+}
+
+void Manning::parallelFor(const size_t& n,
+                          const std::function<void(size_t, size_t, size_t)>& fn) {
+    if (pool == nullptr) {
+        if (n > 0) {
+            fn(0, n, 0);
+        }
+    } else {
+        pool->parallelFor(n, fn);
+    }
 }
 
 }  // namespace gbhs
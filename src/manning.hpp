@@ -1,20 +1,128 @@
 #ifndef EXDIMUM_MANNING_H
 #define EXDIMUM_MANNING_H
 
+#include <functional>
+#include <memory>
 #include <vector>
 
+#include "rain_field.hpp"
 #include "simulation_data.hpp"
+#include "thread_pool.hpp"
+#include "tile_scheduler.hpp"
 
 namespace gbhs {
 
 class Manning {
    public:
-    Manning(SimulationData& data) : data(data) {}
+    Manning(SimulationData& data) : data(data), wet_ranges(1), outflow_rates(1) {}
+    Manning(SimulationData& data, ThreadPool& pool);
     void step(const float& dt);
+    // rain of the spans (see rainRate) falls within the step, it is added to the level
+    // changes together with the inflows
+    void step(const float& dt,
+              const std::vector<RainSpan>& rain_spans,
+              const float& rain_weight);
+    // largest dt [sec] for which no cell loses more than courant of its water in the
+    // next step, infinity without flowing water
+    float stableDt();
+    // multi-rate step, see local_stepping.hpp: the cells of tile t step by tile_dt[t];
+    // tiles with 0 don't step and keep their inflow as level change until they do
+    void step(const std::vector<float>& tile_dt,
+              const std::vector<RainSpan>& rain_spans,
+              const float& rain_weight);
+    // stableDt of every tile
+    void stableTileDt(std::vector<float>& tile_dt);
+    // cells that belong to another domain, see domain_decomposition.hpp: what flows
+    // into them leaves before the level changes are applied and is added up in
+    // outletInflow(), which the caller resets
+    void setOutlets(const std::vector<size_t>& cells);
+    std::vector<float>& outletInflow() { return outlet_inflow; }
+    // called by steps of one dt once the outlets are drained, before the level
+    // changes are applied, e.g. to hand outletInflow() to the domain that owns the
+    // outlets and add what comes back to the level changes; multi-rate steps don't
+    void setOutletExchange(const std::function<void()>& fn) { outlet_exchange = fn; }
+    // owners the inflow gather of a parallel step takes per steal, see
+    // tile_scheduler.hpp
+    void setStealGrain(const size_t& grain);
+    // water [m] that leaves the cell towards its downstream cell within dt
+    float cellOutflow(const size_t& cell_idx, const float& dt) const;
 
    private:
+    // outflow of the cell at position k in cellsWithWater() towards direction d,
+    // order = k * 8 + d
+    struct Inflow {
+        size_t target;
+        size_t order;
+        float amount;
+    };
+
+    // tile_dt overrides dt if it isn't nullptr
+    void stepSerial(const float& dt,
+                    const float* tile_dt,
+                    const std::vector<RainSpan>& rain_spans,
+                    const float& rain_weight);
+    void stepParallel(const float& dt,
+                      const float* tile_dt,
+                      const std::vector<RainSpan>& rain_spans,
+                      const float& rain_weight);
+    // cellOutflow is (dt / r) * h * outflowRate
+    float outflowRate(const size_t& cell_idx) const;
+    // calls fn(target, part, direction) for the downstream cells of cell_idx, the
+    // neighbor with D8 or every direction with a share with multi-flow
+    template <typename Fn>
+    void scatter(const size_t& cell_idx,
+                 const int32_t& neighbor,
+                 const float& amount,
+                 const Fn& fn) const;
+    // adds the rain of span to the level changes of its tile row starting at row_idx;
+    // returns the cells it activated, see SimulationData::activateRow
+    uint64_t addRain(const RainSpan& span,
+                     const size_t& row_idx,
+                     const float& rain_weight,
+                     const float& dt);
+    // splits the tiles into owner_count ranges with about the same number of wet
+    // cells each
+    void partitionOwners();
+    size_t ownerOf(const size_t& cell_idx) const {
+        return tile_owners[cell_idx >> tile_cell_bits];
+    }
+    void apply(const float& dt, const float* tile_dt);
+    void drainOutlets();
+    void applyTiles(const float* tile_dt);
+    void joinWetRanges();
+    void orderCells();
+    // runs on the pool if there is one
+    void parallelFor(const size_t& n,
+                     const std::function<void(size_t, size_t, size_t)>& fn);
+
     SimulationData& data;
-    // void fillDepressions();
+    ThreadPool* pool = nullptr;
+
+    static constexpr float courant = 0.5f;
+    // dense apply once at least 1 / dense_apply_ratio of the wet tiles' cells are wet
+    static constexpr size_t dense_apply_ratio = 4;
+    // cellsWithWater() is put back into index order once 1 / reorder_ratio of it was
+    // activated by inflow since the last time
+    static constexpr size_t reorder_ratio = 8;
+    size_t appended_cells = 0;
+
+    // parallel step: target cells are owned by ranges of whole tiles, owner o has
+    // the tiles [owner_tiles[o], owner_tiles[o + 1]); they follow the wet cells every
+    // step. inflows[thread][owner] keeps the scatter of each thread in list order
+    static constexpr size_t owners_per_thread = 8;
+    size_t owner_count = 1;
+    std::vector<size_t> owner_tiles;
+    std::vector<uint32_t> tile_owners;  // [tile]
+    std::vector<size_t> owner_weights;  // inflows and rain spans of the step
+    std::unique_ptr<TileScheduler> scheduler;
+    std::vector<std::vector<std::vector<Inflow>>> inflows;
+    std::vector<std::vector<std::pair<size_t, size_t>>> activated;  // [owner]
+    std::vector<std::pair<size_t, size_t>> wet_ranges;  // [thread] after compaction
+    std::vector<float> outflow_rates;                   // [thread] stableDt
+    std::vector<uint32_t> tile_rates;                   // stableTileDt, float bits
+    std::vector<size_t> outlets;
+    std::vector<float> outlet_inflow;  // [m] per outlet
+    std::function<void()> outlet_exchange;
 };
 
 }  // namespace gbhs
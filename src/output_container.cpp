@@ -0,0 +1,222 @@
+#include "output_container.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "little_endian.hpp"
+
+namespace gbhs {
+
+namespace {
+
+constexpr char container_magic[8] = {'G', 'B', 'H', 'S', 'R', 'U', 'N', '\0'};
+constexpr char chunk_magic[4] = {'G', 'B', 'H', 'C'};
+constexpr char trailer_magic[8] = {'G', 'B', 'H', 'S', 'E', 'N', 'D', '\0'};
+
+// chunk header: magic, type, step, payload size, payload checksum
+void putChunkHeader(uint8_t* p, const ContainerChunk& chunk, const uint64_t& checksum) {
+    std::memcpy(p, chunk_magic, sizeof(chunk_magic));
+    putU32(p + 4, (uint32_t)chunk.type);
+    putU64(p + 8, chunk.step);
+    putU64(p + 16, chunk.size);
+    putU64(p + 24, checksum);
+}
+
+}  // namespace
+
+void Checksum::update(const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        size_t bytes = std::min(size, sizeof(tail) - tail_size);
+        std::memcpy(tail + tail_size, p, bytes);
+        tail_size += bytes;
+        p += bytes;
+        size -= bytes;
+        if (tail_size == sizeof(tail)) {
+            hash = (hash ^ getU64(tail)) * 1099511628211ull;
+            hash ^= hash >> 29;
+            tail_size = 0;
+        }
+    }
+}
+
+uint64_t Checksum::value() const {
+    if (tail_size == 0) {
+        return hash;
+    }
+    uint8_t padded[8] = {};
+    std::memcpy(padded, tail, tail_size);
+    uint64_t h = (hash ^ getU64(padded)) * 1099511628211ull;
+    return h ^ (h >> 29);
+}
+
+OutputContainer::~OutputContainer() {
+    if (fd >= 0) {
+        close();
+    }
+}
+
+bool OutputContainer::open(const std::string& file, const size_t& preallocation) {
+    this->file = file;
+    this->preallocation = preallocation;
+    fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    uint8_t header[container_header_size] = {};
+    std::memcpy(header, container_magic, sizeof(container_magic));
+    putU32(header + 8, container_version);
+    end = 0;
+    allocated = 0;
+    chunks.clear();
+    if (!writeAt(header, sizeof(header), 0)) {
+        return false;
+    }
+    end = sizeof(header);
+    return true;
+}
+
+bool OutputContainer::writeAt(const void* data,
+                              const size_t& size,
+                              const uint64_t& offset) {
+    // reserve the space in large steps, so the file doesn't fragment
+    if (offset + size > allocated && preallocation > 0) {
+        uint64_t length = (offset + size - allocated + preallocation - 1) /
+                          preallocation * preallocation;
+        // not every file system supports it, the writes below still work then
+        posix_fallocate(fd, allocated, length);
+        allocated += length;
+    }
+
+    const char* p = static_cast<const char*>(data);
+    for (size_t written = 0; written < size;) {
+        ssize_t bytes = pwrite(fd, p + written, size - written, offset + written);
+        if (bytes < 0) {
+            return false;
+        }
+        written += bytes;
+    }
+    return true;
+}
+
+bool OutputContainer::beginChunk(const ChunkType& type, const uint64_t& step) {
+    chunk = {type, step, end + chunk_header_size, 0};
+    checksum = Checksum();
+    return fd >= 0;
+}
+
+bool OutputContainer::append(const void* data, const size_t& size) {
+    if (!writeAt(data, size, chunk.offset + chunk.size)) {
+        return false;
+    }
+    checksum.update(data, size);
+    chunk.size += size;
+    return true;
+}
+
+bool OutputContainer::endChunk() {
+    // the header goes last, until then readers stop in front of the chunk
+    uint8_t header[chunk_header_size];
+    putChunkHeader(header, chunk, checksum.value());
+    if (!writeAt(header, sizeof(header), end)) {
+        return false;
+    }
+    end = chunk.offset + chunk.size;
+    if (chunk.type != ChunkType::index) {
+        chunks.push_back(chunk);
+    }
+    return true;
+}
+
+bool OutputContainer::close() {
+    bool success = fd >= 0;
+    if (success) {
+        uint64_t index_offset = end;
+        std::vector<uint8_t> index(chunk_index_entry_size * chunks.size());
+        uint8_t* p = index.data();
+        for (const ContainerChunk& c : chunks) {
+            putU32(p, (uint32_t)c.type);
+            putU64(p + 8, c.step);
+            putU64(p + 16, c.offset);
+            p += chunk_index_entry_size;
+        }
+        uint8_t trailer[container_trailer_size];
+        putU64(trailer, index_offset);
+        std::memcpy(trailer + 8, trailer_magic, sizeof(trailer_magic));
+
+        // payload sizes follow from the chunk headers
+        success = beginChunk(ChunkType::index, 0) && append(index.data(), index.size()) &&
+                  endChunk() && writeAt(trailer, sizeof(trailer), end) &&
+                  ftruncate(fd, end + sizeof(trailer)) == 0;
+    }
+    if (fd >= 0) {
+        success = ::close(fd) == 0 && success;
+        fd = -1;
+    }
+    return success;
+}
+
+bool readContainerChunks(const uint8_t* data,
+                         const size_t& size,
+                         std::vector<ContainerChunk>& chunks) {
+    chunks.clear();
+    if (size < container_header_size ||
+        std::memcmp(data, container_magic, sizeof(container_magic)) != 0 ||
+        getU32(data + 8) != container_version) {
+        return false;
+    }
+
+    auto readChunk = [&](const uint64_t& offset, ContainerChunk& chunk, bool verify) {
+        if (offset > size || size - offset < chunk_header_size) {
+            return false;
+        }
+        const uint8_t* header = data + offset;
+        chunk = {(ChunkType)getU32(header + 4), getU64(header + 8),
+                 offset + chunk_header_size, getU64(header + 16)};
+        if (std::memcmp(header, chunk_magic, sizeof(chunk_magic)) != 0 ||
+            chunk.size > size - chunk.offset) {
+            return false;
+        }
+        if (verify) {
+            Checksum checksum;
+            checksum.update(data + chunk.offset, chunk.size);
+            return checksum.value() == getU64(header + 24);
+        }
+        return true;
+    };
+
+    // closed run, the trailer points to the index
+    const uint8_t* trailer = data + size - container_trailer_size;
+    ContainerChunk index;
+    if (size >= container_header_size + container_trailer_size &&
+        std::memcmp(trailer + 8, trailer_magic, sizeof(trailer_magic)) == 0 &&
+        readChunk(getU64(trailer), index, true) && index.type == ChunkType::index &&
+        index.size % chunk_index_entry_size == 0) {
+        for (uint64_t i = 0; i < index.size; i += chunk_index_entry_size) {
+            const uint8_t* entry = data + index.offset + i;
+            ContainerChunk chunk;
+            if (!readChunk(getU64(entry + 16) - chunk_header_size, chunk, false)) {
+                return false;
+            }
+            chunks.push_back(chunk);
+        }
+        return true;
+    }
+
+    // otherwise scan, up to the first chunk that is incomplete
+    uint64_t offset = container_header_size;
+    ContainerChunk chunk;
+    while (readChunk(offset, chunk, true)) {
+        if (chunk.type != ChunkType::index) {
+            chunks.push_back(chunk);
+        }
+        offset = chunk.offset + chunk.size;
+    }
+    return true;
+}
+
+}  // namespace gbhs
@@ -0,0 +1,85 @@
+#ifndef EXDIMUM_OUTPUT_CONTAINER_H
+#define EXDIMUM_OUTPUT_CONTAINER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gbhs {
+
+// single append-only output file of a run, little-endian (see README):
+// file header, chunks (metadata, steps), an index chunk and a trailer on close.
+// every chunk header carries the size and checksum of its payload and is written
+// after the payload, so a crashed run is readable up to the last complete chunk
+constexpr uint32_t container_version = 1;
+constexpr size_t container_header_size = 16;
+constexpr size_t chunk_header_size = 32;
+constexpr size_t container_trailer_size = 16;
+constexpr size_t chunk_index_entry_size = 24;
+
+enum class ChunkType : uint32_t {
+    metadata = 1,  // settings and height map
+    step = 2,  // snapshot, see snapshot_format.hpp
+    index = 3,  // offsets of all other chunks
+};
+
+struct ContainerChunk {
+    ChunkType type;
+    uint64_t step;  // simulation step of a step chunk
+    uint64_t offset;  // of the payload, from the start of the file
+    uint64_t size;  // of the payload
+};
+
+// 64 bit words mixed like fnv-1a, the tail is padded with zeros
+class Checksum {
+   public:
+    void update(const void* data, size_t size);
+    uint64_t value() const;
+
+   private:
+    uint64_t hash = 14695981039346656037ull;
+    uint8_t tail[8];
+    size_t tail_size = 0;
+};
+
+// not thread safe, chunks are written one after the other
+class OutputContainer {
+   public:
+    OutputContainer() = default;
+    ~OutputContainer();
+    OutputContainer(const OutputContainer&) = delete;
+    OutputContainer& operator=(const OutputContainer&) = delete;
+
+    // truncates file; disk space is reserved in steps of preallocation bytes
+    bool open(const std::string& file, const size_t& preallocation);
+    bool beginChunk(const ChunkType& type, const uint64_t& step);
+    bool append(const void* data, const size_t& size);
+    bool endChunk();
+    // writes the index and the trailer and releases unused preallocated space
+    bool close();
+
+    const std::string& filename() const { return file; }
+
+   private:
+    bool writeAt(const void* data, const size_t& size, const uint64_t& offset);
+
+    std::string file;
+    int fd = -1;
+    size_t preallocation = 0;
+    uint64_t end = 0;  // of the last complete chunk
+    uint64_t allocated = 0;
+    ContainerChunk chunk;  // the one being written
+    Checksum checksum;
+    std::vector<ContainerChunk> chunks;
+};
+
+// chunks of a container in memory, e.g. a mapped file; uses the index if the run
+// was closed, otherwise every chunk up to the first incomplete one
+bool readContainerChunks(const uint8_t* data,
+                         const size_t& size,
+                         std::vector<ContainerChunk>& chunks);
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,161 @@
+#include "output_writer.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "little_endian.hpp"
+
+namespace gbhs {
+
+namespace {
+
+constexpr size_t buffer_alignment = 4096;
+constexpr size_t metadata_size = 28;
+constexpr size_t height_batch = 1 << 16;  // [cells] converted to little-endian at once
+
+}  // namespace
+
+OutputWriter::OutputWriter(ThreadPool& pool,
+                           const Vec2ui& dimensions,
+                           const float& precision)
+    : pool(pool),
+      encoder(dimensions, precision),
+      worker(&OutputWriter::workerLoop, this) {}
+
+OutputWriter::~OutputWriter() {
+    close();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    staged.notify_all();
+    worker.join();
+    for (Snapshot& snapshot : snapshots) {
+        std::free(snapshot.cells);
+    }
+}
+
+bool OutputWriter::open(const std::string& filename, const size_t& preallocation) {
+    failed = !container.open(filename, preallocation);
+    return !failed;
+}
+
+bool OutputWriter::writeMetadata(const SimulationSettings& settings,
+                                 const SimulationData& data) {
+    // the worker doesn't touch the container while nothing is pending
+    if (!flush()) {
+        return false;
+    }
+
+    uint8_t metadata[metadata_size];
+    putU32(metadata, settings.offset_x);
+    putU32(metadata + 4, settings.offset_y);
+    putU32(metadata + 8, settings.width);
+    putU32(metadata + 12, settings.height);
+    putF32(metadata + 16, settings.dt);
+    putU64(metadata + 20, settings.output_resolution);
+    bool success = container.beginChunk(ChunkType::metadata, 0) &&
+                   container.append(metadata, sizeof(metadata));
+
+    std::vector<uint8_t> heights(sizeof(float) * height_batch);
+    // in raster order, the file doesn't depend on the cell layout
+    const size_t width = data.dimensions.x;
+    const size_t cells = width * data.dimensions.y;
+    for (size_t begin = 0; success && begin < cells; begin += height_batch) {
+        size_t end = std::min(begin + height_batch, cells);
+        for (size_t i = begin; i < end; ++i) {
+            putF32(&heights[sizeof(float) * (i - begin)],
+                   data.height_map[data.cellIndex(i % width, i / width)]);
+        }
+        success = container.append(heights.data(), sizeof(float) * (end - begin));
+    }
+    success = success && container.endChunk();
+    failed = !success;
+    return success;
+}
+
+bool OutputWriter::writeStep(const uint64_t& step, SimulationData& data) {
+    Snapshot& snapshot = snapshots[next_snapshot];
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        written.wait(lock, [&] { return !snapshot.pending; });
+        if (failed) {
+            return false;
+        }
+    }
+
+    // the worker doesn't touch a snapshot that isn't pending
+    const std::vector<size_t>& cells_with_water = data.cellsWithWater();
+    if (snapshot.capacity < cells_with_water.size()) {
+        std::free(snapshot.cells);
+        snapshot.capacity = cells_with_water.size() + cells_with_water.size() / 2;
+        size_t bytes = (sizeof(OutputCell) * snapshot.capacity + buffer_alignment - 1) /
+                       buffer_alignment * buffer_alignment;
+        snapshot.cells =
+            static_cast<OutputCell*>(std::aligned_alloc(buffer_alignment, bytes));
+        if (snapshot.cells == nullptr) {
+            snapshot.capacity = 0;
+            return false;
+        }
+    }
+    snapshot.step = step;
+    snapshot.count = cells_with_water.size();
+    pool.parallelFor(cells_with_water.size(), [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k) {
+            size_t idx = cells_with_water[k];
+            snapshot.cells[k] = {(uint32_t)data.rasterIndex(idx), data.waterLevel(idx)};
+        }
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        snapshot.pending = true;
+    }
+    staged.notify_one();
+    next_snapshot = 1 - next_snapshot;
+    return true;
+}
+
+bool OutputWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [&] { return !snapshots[0].pending && !snapshots[1].pending; });
+    return !failed;
+}
+
+bool OutputWriter::close() {
+    bool success = flush();
+    // a failed run is closed as well, so it stays readable up to the failed step
+    return container.close() && success;
+}
+
+void OutputWriter::workerLoop() {
+    // snapshots are staged alternately, so they are written alternately as well
+    size_t current = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            staged.wait(lock, [&] { return stop || snapshots[current].pending; });
+            if (!snapshots[current].pending) {
+                return;
+            }
+        }
+
+        bool success = writeSnapshot(snapshots[current]);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            failed = failed || !success;
+            snapshots[current].pending = false;
+        }
+        written.notify_all();
+        current = 1 - current;
+    }
+}
+
+bool OutputWriter::writeSnapshot(Snapshot& snapshot) {
+    const std::vector<uint8_t>& encoded = encoder.encode(snapshot.cells, snapshot.count);
+    return container.beginChunk(ChunkType::step, snapshot.step) &&
+           container.append(encoded.data(), encoded.size()) && container.endChunk();
+}
+
+}  // namespace gbhs
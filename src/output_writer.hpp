@@ -0,0 +1,68 @@
+#ifndef EXDIMUM_OUTPUT_WRITER_H
+#define EXDIMUM_OUTPUT_WRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "output_container.hpp"
+#include "simulation_data.hpp"
+#include "snapshot_format.hpp"
+#include "thread_pool.hpp"
+
+namespace gbhs {
+
+// writes the output container of a run; steps are encoded and appended on a background
+// thread with two staging buffers, so the simulation only waits if it produces
+// snapshots faster than they are written
+class OutputWriter {
+   public:
+    // water levels are rounded to precision [m]
+    OutputWriter(ThreadPool& pool, const Vec2ui& dimensions, const float& precision);
+    ~OutputWriter();
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    // disk space is reserved in steps of preallocation bytes
+    bool open(const std::string& filename, const size_t& preallocation);
+    // settings and height map, written right away
+    bool writeMetadata(const SimulationSettings& settings, const SimulationData& data);
+    // copies the water levels of all wet cells into a staging buffer and returns
+    // before they are written; false if an earlier write failed
+    bool writeStep(const uint64_t& step, SimulationData& data);
+    // waits for all pending writes; false if one of them failed
+    bool flush();
+    // flushes and finishes the container with its index
+    bool close();
+    const std::string& filename() const { return container.filename(); }
+
+   private:
+    struct Snapshot {
+        uint64_t step = 0;
+        OutputCell* cells = nullptr;  // page aligned
+        size_t capacity = 0;
+        uint32_t count = 0;
+        bool pending = false;
+    };
+
+    void workerLoop();
+    bool writeSnapshot(Snapshot& snapshot);
+
+    ThreadPool& pool;
+    SnapshotEncoder encoder;  // only used by the worker
+    OutputContainer container;  // used by the worker while a snapshot is pending
+    Snapshot snapshots[2];
+    size_t next_snapshot = 0;  // the one staged next
+    std::mutex mutex;
+    std::condition_variable staged;
+    std::condition_variable written;
+    bool stop = false;
+    bool failed = false;
+    std::thread worker;
+};
+
+}  // namespace gbhs
+
+#endif
@@ -166,6 +166,10 @@ namespace siv
 		[[nodiscard]]
 		value_type noise3D_01(value_type x, value_type y, value_type z) const noexcept;
 
+		// out[i] = noise2D_01(x + i * dx, y) for i in [0, count); the lattice hashes only
+		// change where x crosses an integer, in between the noise is plain arithmetic
+		void noise2DRow_01(value_type* out, value_type x, value_type dx, value_type y, std::size_t count) const noexcept;
+
 		///////////////////////////////////////
 		//
 		//	Octave noise (The result can be out of the range [-1, 1])
@@ -553,6 +557,90 @@ namespace siv
 		return perlin_detail::Remap_01(noise3D(x, y, z));
 	}
 
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2DRow_01(value_type* out, const value_type x, const value_type dx, const value_type y, const std::size_t count) const noexcept
+	{
+		const value_type z = static_cast<value_type>(SIVPERLIN_DEFAULT_Z);
+		const value_type _y = std::floor(y);
+		const value_type _z = std::floor(z);
+
+		const std::int32_t iy = static_cast<std::int32_t>(_y) & 255;
+		const std::int32_t iz = static_cast<std::int32_t>(_z) & 255;
+
+		const value_type fy = (y - _y);
+		const value_type fz = (z - _z);
+
+		const value_type v = perlin_detail::Fade(fy);
+		const value_type w = perlin_detail::Fade(fz);
+
+		const std::int32_t n = static_cast<std::int32_t>(count);
+		const auto position = [&](const std::int32_t i) { return x + static_cast<value_type>(i) * dx; };
+
+		std::int32_t begin = 0;
+		while (begin < n)
+		{
+			// [begin, end) lies in one lattice cell, the estimate is corrected for rounding
+			const value_type _x = std::floor(position(begin));
+			std::int32_t end = begin + 1;
+			if (dx > 0)
+			{
+				const value_type steps = (_x + 1 - position(begin)) / dx;
+				end = steps < static_cast<value_type>(n - begin) ? begin + std::max(1, static_cast<std::int32_t>(steps)) : n;
+			}
+			while ((end - 1 > begin) && (std::floor(position(end - 1)) != _x))
+			{
+				--end;
+			}
+			while ((end < n) && (std::floor(position(end)) == _x))
+			{
+				++end;
+			}
+
+			const std::int32_t ix = static_cast<std::int32_t>(_x) & 255;
+
+			const std::uint8_t A = (m_permutation[ix & 255] + iy) & 255;
+			const std::uint8_t B = (m_permutation[(ix + 1) & 255] + iy) & 255;
+
+			const std::uint8_t AA = (m_permutation[A] + iz) & 255;
+			const std::uint8_t AB = (m_permutation[(A + 1) & 255] + iz) & 255;
+
+			const std::uint8_t BA = (m_permutation[B] + iz) & 255;
+			const std::uint8_t BB = (m_permutation[(B + 1) & 255] + iz) & 255;
+
+			// every gradient is linear in fx: c + g * fx
+			const std::uint8_t hashes[8] = { m_permutation[AA], m_permutation[BA], m_permutation[AB], m_permutation[BB],
+				m_permutation[(AA + 1) & 255], m_permutation[(BA + 1) & 255], m_permutation[(AB + 1) & 255], m_permutation[(BB + 1) & 255] };
+			value_type c[8];
+			value_type g[8];
+			for (std::int32_t k = 0; k < 8; ++k)
+			{
+				const value_type ox = static_cast<value_type>(k & 1);
+				const value_type gy = fy - static_cast<value_type>((k >> 1) & 1);
+				const value_type gz = fz - static_cast<value_type>(k >> 2);
+				c[k] = perlin_detail::Grad(hashes[k], -ox, gy, gz);
+				g[k] = perlin_detail::Grad(hashes[k], 1 - ox, gy, gz) - c[k];
+			}
+
+			for (std::int32_t i = begin; i < end; ++i)
+			{
+				const value_type fx = position(i) - _x;
+				const value_type u = perlin_detail::Fade(fx);
+
+				const value_type q0 = perlin_detail::Lerp(c[0] + g[0] * fx, c[1] + g[1] * fx, u);
+				const value_type q1 = perlin_detail::Lerp(c[2] + g[2] * fx, c[3] + g[3] * fx, u);
+				const value_type q2 = perlin_detail::Lerp(c[4] + g[4] * fx, c[5] + g[5] * fx, u);
+				const value_type q3 = perlin_detail::Lerp(c[6] + g[6] * fx, c[7] + g[7] * fx, u);
+
+				const value_type r0 = perlin_detail::Lerp(q0, q1, v);
+				const value_type r1 = perlin_detail::Lerp(q2, q3, v);
+
+				out[i] = perlin_detail::Remap_01(perlin_detail::Lerp(r0, r1, w));
+			}
+
+			begin = end;
+		}
+	}
+
 	///////////////////////////////////////
 
 	template <class Float>
@@ -0,0 +1,197 @@
+#include "rain_field.hpp"
+
+namespace gbhs {
+
+namespace {
+
+constexpr siv::BasicPerlinNoise<float>::seed_type rain_seed = 123456u;
+constexpr float rain_scale = 4000.f;  // [cells] per noise lattice cell
+constexpr float rain_threshold = 0.7f;
+constexpr float rain_factor = 3.333f;  // intensity per noise above the threshold
+constexpr float rain_rate = 0.005f;  // [m/s] at intensity 1
+
+// first x of [begin, end) for which pred holds, end if there is none; pred has to be
+// false up to some x and true from there on
+template <typename Pred>
+size_t firstOf(size_t begin, size_t end, const Pred& pred) {
+    while (begin < end) {
+        size_t mid = begin + (end - begin) / 2;
+        if (pred(mid)) {
+            end = mid;
+        } else {
+            begin = mid + 1;
+        }
+    }
+    return begin;
+}
+
+}  // namespace
+
+RainLattice::RainLattice(const SimulationData& data,
+                         ThreadPool& pool,
+                         const size_t& row_phase)
+    : data(data),
+      row_phase(row_phase % rain_lattice),
+      lattice_width((data.dimensions.x + rain_lattice - 1) / rain_lattice + 1),
+      lattice_height((data.dimensions.y + this->row_phase + rain_lattice - 1) /
+                         rain_lattice +
+                     1),
+      thread_spans(pool.size()) {
+    // spans of each row band, joined in row order
+    const size_t width = data.dimensions.x;
+    const size_t height = data.dimensions.y;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> band_spans(pool.size());
+    std::vector<size_t> span_counts(height, 0);
+    pool.parallelFor(height, [&](size_t begin, size_t end, size_t thread_idx) {
+        for (size_t y = begin; y < end; ++y) {
+            auto land = [&](const size_t& x) {
+                return data.height_map[data.cellIndex(x, y)] >= 0.f;
+            };
+            for (size_t x = 0; x < width;) {
+                if (!land(x)) {
+                    ++x;
+                    continue;
+                }
+                size_t span_begin = x;
+                while (x < width && land(x)) {
+                    ++x;
+                }
+                band_spans[thread_idx].push_back({span_begin, x});
+                ++span_counts[y];
+            }
+        }
+    });
+
+    row_spans.resize(height + 1, 0);
+    for (size_t y = 0; y < height; ++y) {
+        row_spans[y + 1] = row_spans[y] + span_counts[y];
+    }
+    for (const auto& spans : band_spans) {
+        land_spans.insert(land_spans.end(), spans.begin(), spans.end());
+    }
+}
+
+void RainLattice::spans(const float* frame_a,
+                        const float* frame_b,
+                        std::vector<RainSpan>& spans) {
+    std::vector<float> rows[2];
+    spans.clear();
+    rowSpans(frame_a, frame_b, 0, data.dimensions.y, rows, spans);
+}
+
+void RainLattice::spans(const float* frame_a,
+                        const float* frame_b,
+                        std::vector<RainSpan>& spans,
+                        ThreadPool& pool) {
+    for (auto& band : thread_spans) {
+        band.clear();
+    }
+    pool.parallelFor(data.dimensions.y, [&](size_t begin, size_t end, size_t thread_idx) {
+        std::vector<float> rows[2];
+        rowSpans(frame_a, frame_b, begin, end, rows, thread_spans[thread_idx]);
+    });
+
+    spans.clear();
+    for (const auto& band : thread_spans) {
+        spans.insert(spans.end(), band.begin(), band.end());
+    }
+}
+
+void RainLattice::rowSpans(const float* frame_a,
+                           const float* frame_b,
+                           const size_t& row_begin,
+                           const size_t& row_end,
+                           std::vector<float> (&rows)[2],
+                           std::vector<RainSpan>& spans) const {
+    const size_t width = data.dimensions.x;
+    const float* frames[2] = {frame_a, frame_b};
+    for (size_t y = row_begin; y < row_end; ++y) {
+        // interpolated between the lattice rows above and below
+        const size_t lattice_y = y + row_phase;
+        const float ty = (float)(lattice_y % rain_lattice) / rain_lattice;
+        for (size_t k = 0; k < 2; ++k) {
+            const float* above = frames[k] + lattice_y / rain_lattice * lattice_width;
+            const float* below = above + lattice_width;
+            rows[k].resize(lattice_width);
+            for (size_t i = 0; i < lattice_width; ++i) {
+                rows[k][i] = above[i] + (below[i] - above[i]) * ty;
+            }
+        }
+
+        // linear between two lattice columns, so the cells with rain in either frame
+        // are one range each
+        size_t s = row_spans[y];
+        const size_t s_end = row_spans[y + 1];
+        for (size_t i = 0; i + 1 < lattice_width && s < s_end; ++i) {
+            RainSpan segment{(uint32_t)y,
+                             (uint32_t)(i * rain_lattice),
+                             (uint32_t)std::min((i + 1) * rain_lattice, width),
+                             {rows[0][i], rows[1][i]},
+                             {(rows[0][i + 1] - rows[0][i]) / rain_lattice,
+                              (rows[1][i + 1] - rows[1][i]) / rain_lattice}};
+            size_t rain_begin = segment.x_end;
+            size_t rain_end = segment.x_begin;
+            for (size_t k = 0; k < 2; ++k) {
+                // same expression as rainRate
+                auto raining = [&](size_t x) {
+                    float dx = x - segment.x_begin;
+                    return segment.rate[k] + segment.slope[k] * dx > 0.f;
+                };
+                size_t begin = segment.x_begin;
+                size_t end = segment.x_end;
+                if (segment.slope[k] >= 0.f) {
+                    begin = firstOf(begin, end, raining);
+                } else {
+                    end = firstOf(begin, end, [&](size_t x) { return !raining(x); });
+                }
+                if (begin < end) {
+                    rain_begin = std::min(rain_begin, begin);
+                    rain_end = std::max(rain_end, end);
+                }
+            }
+            if (rain_begin >= rain_end) {
+                continue;
+            }
+
+            // only on land
+            while (s < s_end && land_spans[s].second <= rain_begin) {
+                ++s;
+            }
+            for (size_t t = s; t < s_end && land_spans[t].first < rain_end; ++t) {
+                RainSpan span = segment;
+                span.x_begin = std::max<size_t>(rain_begin, land_spans[t].first);
+                span.x_end = std::min<size_t>(rain_end, land_spans[t].second);
+                spans.push_back(span);
+            }
+        }
+    }
+}
+
+RainField::RainField(const SimulationData& data,
+                     ThreadPool& pool,
+                     const size_t& row_phase)
+    : pool(pool),
+      lattice(data, pool, row_phase),
+      perlin(rain_seed),
+      rates(lattice.width() * lattice.height()) {}
+
+void RainField::decide(std::vector<RainSpan>& rain_spans, const Vec2ui& offset) {
+    // the noise varies over thousands of cells, it is only evaluated at the lattice
+    const size_t width = lattice.width();
+    pool.parallelFor(lattice.height(), [&](size_t begin, size_t end, size_t) {
+        for (size_t j = begin; j < end; ++j) {
+            float* row = &rates[j * width];
+            perlin.noise2DRow_01(row,
+                                 offset.x / rain_scale,
+                                 rain_lattice / rain_scale,
+                                 (lattice.row(j) + int64_t(offset.y)) / rain_scale,
+                                 width);
+            for (size_t i = 0; i < width; ++i) {
+                row[i] = (row[i] - rain_threshold) * rain_factor * rain_rate;
+            }
+        }
+    });
+    lattice.spans(rates.data(), rates.data(), rain_spans, pool);
+}
+
+}  // namespace gbhs
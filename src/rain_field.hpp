@@ -0,0 +1,101 @@
+#ifndef EXDIMUM_RAIN_FIELD_H
+#define EXDIMUM_RAIN_FIELD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "perlin_noise.hpp"
+#include "simulation_data.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+namespace gbhs {
+
+// rain is given at the points of a lattice with this spacing [cells] and bilinearly
+// interpolated in between; aligned with the tiles, so a span stays inside one tile
+constexpr size_t rain_lattice = tile_size;
+
+// cells [x_begin, x_end) of a row that get rain, see rainRate
+struct RainSpan {
+    uint32_t y;
+    uint32_t x_begin;
+    uint32_t x_end;
+    // [m/s] at the lattice column the span starts in, linear along the span; negative
+    // means no rain. two frames, the rate is interpolated between them
+    float rate[2];
+    float slope[2];  // [m/s per cell]
+};
+
+// weight 0 is the first frame, 1 the second
+inline float rainRate(const RainSpan& span, const size_t& x, const float& weight) {
+    float dx = x - (span.x_begin - span.x_begin % rain_lattice);
+    float a = std::max(0.f, span.rate[0] + span.slope[0] * dx);
+    float b = std::max(0.f, span.rate[1] + span.slope[1] * dx);
+    return a + (b - a) * weight;
+}
+
+// turns rain rates at the lattice points into spans of the cells with rain; cells
+// without data never get rain, their spans are found once
+class RainLattice {
+   public:
+    // the lattice rows lie on the rows of a larger window whose row row_phase is the
+    // first row of data (mod rain_lattice), e.g. the strip of a distributed run
+    RainLattice(const SimulationData& data,
+                ThreadPool& pool,
+                const size_t& row_phase = 0);
+
+    // lattice point (i, j) is cell (i * rain_lattice, row(j))
+    size_t width() const { return lattice_width; }
+    size_t height() const { return lattice_height; }
+    // the first lattice row can be above the first row of data
+    int64_t row(const size_t& j) const { return int64_t(j * rain_lattice) - row_phase; }
+
+    // rates of two frames, width() x height() each; replaces spans, in raster order
+    void spans(const float* frame_a, const float* frame_b, std::vector<RainSpan>& spans);
+    void spans(const float* frame_a,
+               const float* frame_b,
+               std::vector<RainSpan>& spans,
+               ThreadPool& pool);
+
+   private:
+    void rowSpans(const float* frame_a,
+                  const float* frame_b,
+                  const size_t& row_begin,
+                  const size_t& row_end,
+                  std::vector<float> (&rows)[2],
+                  std::vector<RainSpan>& spans) const;
+
+    const SimulationData& data;
+    // [x begin, x end) of the cells with data, row y owns the spans
+    // [row_spans[y], row_spans[y + 1])
+    std::vector<std::pair<uint32_t, uint32_t>> land_spans;
+    std::vector<size_t> row_spans;
+    size_t row_phase;
+    size_t lattice_width;
+    size_t lattice_height;
+    // per thread
+    std::vector<std::vector<RainSpan>> thread_spans;
+};
+
+// synthetic rain wherever a perlin noise field is above a threshold
+class RainField {
+   public:
+    // see RainLattice for row_phase
+    RainField(const SimulationData& data, ThreadPool& pool, const size_t& row_phase = 0);
+
+    // replaces rain_spans with the spans of the field shifted by offset, both frames
+    // of a span are the same; cell (x, y) samples the field at (x, y) + offset
+    void decide(std::vector<RainSpan>& rain_spans, const Vec2ui& offset);
+
+   private:
+    ThreadPool& pool;
+    RainLattice lattice;
+    siv::BasicPerlinNoise<float> perlin;
+    std::vector<float> rates;  // at the lattice points
+};
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,217 @@
+#include "rain_forcing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "gdal_priv.h"
+
+namespace gbhs {
+
+namespace {
+
+constexpr size_t frames_ahead = 2;  // frame pairs read ahead of the simulation
+constexpr double mm_per_hour = 1.0 / 3600000.0;  // [m/s]
+
+}  // namespace
+
+RainForcing::RainForcing(const SimulationData& data,
+                         ThreadPool& pool,
+                         const size_t& row_phase)
+    : lattice(data, pool, row_phase) {}
+
+RainForcing::~RainForcing() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    taken.notify_all();
+    if (reader.joinable()) {
+        reader.join();
+    }
+}
+
+bool RainForcing::open(const char* list_file,
+                       const char* geo_file,
+                       const SimulationSettings& settings) {
+    // relative raster paths are relative to the list
+    std::ifstream rs(list_file);
+    if (!rs.is_open()) {
+        return false;
+    }
+    std::string directory = list_file;
+    directory.erase(directory.find_last_of('/') + 1);
+    std::string line;
+    while (std::getline(rs, line)) {
+        std::istringstream ls(line);
+        Frame frame;
+        if (!(ls >> frame.time)) {
+            continue;  // empty line
+        }
+        ls >> std::ws;
+        std::getline(ls, frame.file);
+        if (frame.file.empty() || (!frames.empty() && frame.time <= frames.back().time)) {
+            return false;
+        }
+        if (frame.file[0] != '/') {
+            frame.file = directory + frame.file;
+        }
+        frames.push_back(frame);
+    }
+    if (frames.size() < 2) {
+        return false;
+    }
+
+    GDALAllRegister();
+    GDALDataset* dataset = (GDALDataset*)GDALOpen(geo_file, GA_ReadOnly);
+    if (dataset == NULL) {
+        return false;
+    }
+    bool georeferenced = dataset->GetGeoTransform(geo_transform) == CE_None;
+    GDALClose(dataset);
+    if (!georeferenced) {
+        return false;
+    }
+    // origin of the simulation window
+    geo_transform[0] +=
+        settings.offset_x * geo_transform[1] + settings.offset_y * geo_transform[2];
+    geo_transform[3] +=
+        settings.offset_x * geo_transform[4] + settings.offset_y * geo_transform[5];
+
+    reader = std::thread(&RainForcing::readerLoop, this);
+    std::unique_lock<std::mutex> lock(mutex);
+    read.wait(lock, [&] { return !ready.empty() || !failed_file.empty(); });
+    return failed_file.empty();
+}
+
+void RainForcing::update(const double& time) {
+    // the first pair is ready since open, later ones are skipped if they are late
+    while (current_frame == 0 ||
+           (current_frame + 1 < frames.size() && time > frames[current_frame].time)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ready.empty()) {
+                break;
+            }
+            current_spans.swap(ready.front().spans);
+            current_frame = ready.front().frame;
+            ready.pop_front();
+        }
+        taken.notify_one();
+    }
+    if (current_frame == 0) {
+        return;
+    }
+
+    in_series = time >= frames.front().time && time <= frames.back().time;
+    const Frame& previous = frames[current_frame - 1];
+    const Frame& next = frames[current_frame];
+    current_weight = std::min(1.0, std::max(0.0, (time - previous.time) /
+                                                     (next.time - previous.time)));
+}
+
+bool RainForcing::good() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed_file.empty();
+}
+
+bool RainForcing::readFrame(const Frame& frame, std::vector<float>& rates) const {
+    GDALDataset* dataset = (GDALDataset*)GDALOpen(frame.file.c_str(), GA_ReadOnly);
+    if (dataset == NULL) {
+        return false;
+    }
+    double transform[6];
+    if (dataset->GetRasterCount() < 1 || dataset->GetGeoTransform(transform) != CE_None ||
+        transform[2] != 0.0 || transform[4] != 0.0) {
+        GDALClose(dataset);
+        return false;  // only north-up rasters
+    }
+    const int width = dataset->GetRasterXSize();
+    const int height = dataset->GetRasterYSize();
+    std::vector<float> raster(size_t(width) * height);
+    GDALRasterBand* band = dataset->GetRasterBand(1);
+    CPLErr err = band->RasterIO(GF_Read,
+                                0,
+                                0,
+                                width,
+                                height,
+                                raster.data(),
+                                width,
+                                height,
+                                GDT_Float32,
+                                0,
+                                0);
+    int has_no_data = 0;
+    float no_data = band->GetNoDataValue(&has_no_data);
+    GDALClose(dataset);
+    if (err != CE_None) {
+        return false;
+    }
+    for (float& value : raster) {
+        if (!(value > 0.f) || (has_no_data && value == no_data)) {
+            value = 0.f;
+        }
+    }
+
+    // bilinear between the pixel centers of the raster at every lattice point,
+    // no rain outside of the raster
+    rates.resize(lattice.width() * lattice.height());
+    for (size_t j = 0; j < lattice.height(); ++j) {
+        for (size_t i = 0; i < lattice.width(); ++i) {
+            double px = i * rain_lattice + 0.5;
+            double py = lattice.row(j) + 0.5;
+            double x = geo_transform[0] + px * geo_transform[1] + py * geo_transform[2];
+            double y = geo_transform[3] + px * geo_transform[4] + py * geo_transform[5];
+            double fx = (x - transform[0]) / transform[1] - 0.5;
+            double fy = (y - transform[3]) / transform[5] - 0.5;
+            float& rate = rates[i + j * lattice.width()];
+            if (fx < -0.5 || fy < -0.5 || fx > width - 0.5 || fy > height - 0.5) {
+                rate = 0.f;
+                continue;
+            }
+            fx = std::min(std::max(fx, 0.0), width - 1.0);
+            fy = std::min(std::max(fy, 0.0), height - 1.0);
+            size_t x0 = (size_t)fx;
+            size_t y0 = (size_t)fy;
+            size_t x1 = std::min<size_t>(x0 + 1, width - 1);
+            size_t y1 = std::min<size_t>(y0 + 1, height - 1);
+            float tx = fx - x0;
+            float ty = fy - y0;
+            float top = raster[x0 + y0 * width] +
+                        (raster[x1 + y0 * width] - raster[x0 + y0 * width]) * tx;
+            float bottom = raster[x0 + y1 * width] +
+                           (raster[x1 + y1 * width] - raster[x0 + y1 * width]) * tx;
+            rate = (top + (bottom - top) * ty) * mm_per_hour;
+        }
+    }
+    return true;
+}
+
+void RainForcing::readerLoop() {
+    std::vector<float> previous;
+    std::vector<float> rates;
+    for (size_t k = 0; k < frames.size(); ++k) {
+        if (!readFrame(frames[k], rates)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failed_file = frames[k].file;
+            read.notify_all();
+            return;
+        }
+        if (k > 0) {
+            // spans on this thread as well, the simulation only swaps them in
+            FramePair pair{k, {}};
+            lattice.spans(previous.data(), rates.data(), pair.spans);
+            std::unique_lock<std::mutex> lock(mutex);
+            taken.wait(lock, [&] { return stop || ready.size() < frames_ahead; });
+            if (stop) {
+                return;
+            }
+            ready.push_back(std::move(pair));
+            read.notify_all();
+        }
+        previous.swap(rates);
+    }
+}
+
+}  // namespace gbhs
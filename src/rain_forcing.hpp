@@ -0,0 +1,86 @@
+#ifndef EXDIMUM_RAIN_FORCING_H
+#define EXDIMUM_RAIN_FORCING_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rain_field.hpp"
+#include "simulation_data.hpp"
+#include "thread_pool.hpp"
+
+namespace gbhs {
+
+// rain from a series of precipitation rasters (e.g. radar grids, rate in mm/h),
+// linearly interpolated in time and bilinearly resampled to the simulation. the
+// rasters have to be north-up and in the coordinate system of the geo dataset.
+// frames are read and turned into spans on a background thread ahead of time,
+// the simulation never waits for them
+class RainForcing {
+   public:
+    // see RainLattice for row_phase
+    RainForcing(const SimulationData& data,
+                ThreadPool& pool,
+                const size_t& row_phase = 0);
+    ~RainForcing();
+    RainForcing(const RainForcing&) = delete;
+    RainForcing& operator=(const RainForcing&) = delete;
+
+    // list_file has one "<time [s]> <raster file>" per line in ascending time, at
+    // least two; geo_file is the geo dataset of the simulation. waits for the first
+    // two frames
+    bool open(const char* list_file,
+              const char* geo_file,
+              const SimulationSettings& settings);
+
+    // moves on to the frames around time [s]; holds the last frame that was read if
+    // the next one isn't ready yet
+    void update(const double& time);
+    // empty outside of the series
+    const std::vector<RainSpan>& spans() const {
+        return in_series ? current_spans : no_spans;
+    }
+    float weight() const { return current_weight; }
+    // false once a frame couldn't be read
+    bool good();
+    const std::string& failedFile() const { return failed_file; }
+
+   private:
+    struct Frame {
+        double time;  // [s]
+        std::string file;
+    };
+    // spans between frame - 1 and frame
+    struct FramePair {
+        size_t frame;
+        std::vector<RainSpan> spans;
+    };
+
+    bool readFrame(const Frame& frame, std::vector<float>& rates) const;
+    void readerLoop();
+
+    RainLattice lattice;
+    double geo_transform[6];  // of the geo dataset, shifted to the simulation window
+    std::vector<Frame> frames;
+
+    size_t current_frame = 0;  // the spans are between current_frame - 1 and it
+    std::vector<RainSpan> current_spans;
+    float current_weight = 0.f;
+    bool in_series = false;
+    const std::vector<RainSpan> no_spans;
+
+    std::mutex mutex;
+    std::condition_variable read;
+    std::condition_variable taken;
+    std::deque<FramePair> ready;
+    bool stop = false;
+    std::string failed_file;
+    std::thread reader;
+};
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,180 @@
+#include "raster_cache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace gbhs {
+
+namespace {
+
+uint64_t alignUp(const uint64_t& offset) {
+    return (offset + cache_alignment - 1) / cache_alignment * cache_alignment;
+}
+
+// header of the cache for the current settings, without the source checksum
+RasterCacheHeader expectedHeader(const SimulationSettings& settings,
+                                 const SimulationData& data) {
+    RasterCacheHeader header;
+    header.offset_x = settings.offset_x;
+    header.offset_y = settings.offset_y;
+    header.width = settings.width;
+    header.height = settings.height;
+    header.depressions_filled = settings.fill_depressions;
+    header.height_map_offset = alignUp(sizeof(RasterCacheHeader));
+    header.neighbours_offset =
+        alignUp(header.height_map_offset + sizeof(float) * data.height_map.size());
+    header.flow_coefficients_offset = alignUp(
+        header.neighbours_offset + sizeof(int32_t) * data.neighbourMap().size());
+    header.file_size = header.flow_coefficients_offset +
+                       sizeof(float) * data.flowCoefficientMap().size();
+    return header;
+}
+
+bool writePadded(std::ofstream& ws, const void* buffer, const size_t& size) {
+    static const char zeros[cache_alignment] = {};
+    ws.write(reinterpret_cast<const char*>(buffer), size);
+    ws.write(zeros, alignUp(size) - size);
+    return ws.good();
+}
+
+}  // namespace
+
+bool fileChecksum(const char* file, uint64_t& size, uint64_t& checksum) {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    // 64 bit words mixed like fnv-1a, the tail is padded with zeros
+    std::vector<uint64_t> buffer(1 << 17);
+    size = 0;
+    checksum = 14695981039346656037ull;
+    ssize_t bytes = 0;
+    while ((bytes = read(fd, buffer.data(), sizeof(uint64_t) * buffer.size())) > 0) {
+        std::memset(reinterpret_cast<char*>(buffer.data()) + bytes,
+                    0,
+                    (sizeof(uint64_t) - bytes % sizeof(uint64_t)) % sizeof(uint64_t));
+        for (size_t i = 0; i < (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t); ++i) {
+            checksum = (checksum ^ buffer[i]) * 1099511628211ull;
+            checksum ^= checksum >> 29;
+        }
+        size += bytes;
+    }
+    close(fd);
+    return bytes == 0;
+}
+
+bool readRasterCache(const char* cache_file,
+                     const char* source_file,
+                     const SimulationSettings& settings,
+                     SimulationData& data) {
+    int fd = open(cache_file, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    RasterCacheHeader header;
+    RasterCacheHeader expected = expectedHeader(settings, data);
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size != expected.file_size ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.version != expected.version || header.tile_bits != expected.tile_bits ||
+        header.offset_x != expected.offset_x || header.offset_y != expected.offset_y ||
+        header.width != expected.width || header.height != expected.height ||
+        header.depressions_filled != expected.depressions_filled ||
+        // the arrays are mapped where the header says, a corrupt layout is rejected
+        header.height_map_offset != expected.height_map_offset ||
+        header.neighbours_offset != expected.neighbours_offset ||
+        header.flow_coefficients_offset != expected.flow_coefficients_offset ||
+        header.file_size != expected.file_size) {
+        close(fd);
+        return false;
+    }
+
+    // a changed source invalidates the cache
+    if (!fileChecksum(source_file, expected.source_size, expected.source_checksum) ||
+        header.source_size != expected.source_size ||
+        header.source_checksum != expected.source_checksum) {
+        close(fd);
+        return false;
+    }
+
+    // private mapping: nothing is written back to the cache
+    void* mapping =
+        mmap(nullptr, header.file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    const size_t file_size = header.file_size;
+    std::shared_ptr<char> file(static_cast<char*>(mapping),
+                               [file_size](char* p) { munmap(p, file_size); });
+
+    const Array2D<int32_t, CellLayout>& neighbours = data.neighbourMap();
+    const Array2D<float, CellLayout>& flow_coefficients = data.flowCoefficientMap();
+    data.mapTopography(
+        Array2D<float, CellLayout>(
+            data.height_map.width,
+            data.height_map.height,
+            std::shared_ptr<float[]>(
+                file, reinterpret_cast<float*>(file.get() + header.height_map_offset))),
+        Array2D<int32_t, CellLayout>(
+            neighbours.width,
+            neighbours.height,
+            std::shared_ptr<int32_t[]>(
+                file, reinterpret_cast<int32_t*>(file.get() + header.neighbours_offset))),
+        Array2D<float, CellLayout>(
+            flow_coefficients.width,
+            flow_coefficients.height,
+            std::shared_ptr<float[]>(
+                file,
+                reinterpret_cast<float*>(file.get() + header.flow_coefficients_offset))));
+    return true;
+}
+
+bool writeRasterCache(const char* cache_file,
+                      const char* source_file,
+                      const SimulationSettings& settings,
+                      const SimulationData& data) {
+    RasterCacheHeader header = expectedHeader(settings, data);
+    if (!fileChecksum(source_file, header.source_size, header.source_checksum)) {
+        return false;
+    }
+
+    // written next to the cache and renamed, so a cache is either complete or missing
+    std::string tmp_file = std::string(cache_file) + ".tmp";
+    std::ofstream ws(tmp_file, std::ios::binary);
+    if (!ws.is_open()) {
+        return false;
+    }
+    bool success =
+        writePadded(ws, &header, sizeof(header)) &&
+        writePadded(ws, data.height_map.ptr(), sizeof(float) * data.height_map.size()) &&
+        writePadded(ws,
+                    data.neighbourMap().ptr(),
+                    sizeof(int32_t) * data.neighbourMap().size());
+    if (success) {
+        // no padding after the last array
+        ws.write(reinterpret_cast<const char*>(data.flowCoefficientMap().ptr()),
+                 sizeof(float) * data.flowCoefficientMap().size());
+        success = ws.good();
+    }
+    // close flushes the buffer, a full disk only shows up here
+    ws.close();
+    success = success && !ws.fail();
+    if (!success || std::rename(tmp_file.c_str(), cache_file) != 0) {
+        std::remove(tmp_file.c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace gbhs
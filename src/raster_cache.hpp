@@ -0,0 +1,52 @@
+#ifndef EXDIMUM_RASTER_CACHE_H
+#define EXDIMUM_RASTER_CACHE_H
+
+#include <cstdint>
+
+#include "simulation_data.hpp"
+
+namespace gbhs {
+
+// preprocessed copy of one window of a dataset: header, height map, downstream
+// neighbours and flow coefficients as raw native binaries, every array starts at a
+// multiple of cache_alignment so the file can be mapped instead of read
+constexpr uint64_t cache_alignment = 4096;
+constexpr uint32_t cache_version = 3;
+
+struct RasterCacheHeader {
+    char magic[8] = {'G', 'B', 'H', 'S', 'C', 'A', 'C', 'H'};
+    uint32_t version = cache_version;
+    uint32_t tile_bits = gbhs::tile_bits;
+    int32_t offset_x = 0;
+    int32_t offset_y = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    uint32_t depressions_filled = 0;
+    uint32_t reserved = 0;
+    uint64_t source_size = 0;
+    uint64_t source_checksum = 0;
+    uint64_t height_map_offset = 0;  // [bytes]
+    uint64_t neighbours_offset = 0;
+    uint64_t flow_coefficients_offset = 0;
+    uint64_t file_size = 0;
+};
+
+// checksum over the content of a file, false if it can't be read
+bool fileChecksum(const char* file, uint64_t& size, uint64_t& checksum);
+
+// maps the cache into data if it was made from source_file for the window in settings,
+// false if there is no such cache
+bool readRasterCache(const char* cache_file,
+                     const char* source_file,
+                     const SimulationSettings& settings,
+                     SimulationData& data);
+
+// data has to be loaded and findNeighbours done
+bool writeRasterCache(const char* cache_file,
+                      const char* source_file,
+                      const SimulationSettings& settings,
+                      const SimulationData& data);
+
+}  // namespace gbhs
+
+#endif
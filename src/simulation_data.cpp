@@ -2,116 +2,253 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <stdexcept>
 
 namespace gbhs {
 
-SimulationData::SimulationData(const size_t& width, const size_t& height) {
-    height_map = Array2D<float>(width, height);
-    cells = Array2D<Cell>(width, height);
+SimulationData::SimulationData(const size_t& width,
+                               const size_t& height,
+                               const GridMemory& memory)
+    : grid(width, height), memory(memory) {
+    if (!fits(width, height)) {
+        throw std::length_error("grid too large for int32 cell indices");
+    }
+    // mapped lazily, the height map is read and findNeighbours sets every cell
+    height_map = gridArray<float, CellLayout>(width, height, memory);
+    neighbours = gridArray<int32_t, CellLayout>(width, height, memory);
+    flow_coefficients = gridArray<float, CellLayout>(width, height, memory);
+    hydraulic_tiles.resize(grid.tileCount(), nullptr);
+    active.resize(grid.cellCount() / 64, 0);
     dimensions = {width, height};  // TODO min dimension 3x3
 }
 
-void SimulationData::findNeighbours() {
-    for (int iy = 0; iy < dimensions.y; ++iy) {
-        for (int ix = 0; ix < dimensions.x; ++ix) {
-            size_t cell_idx = ix + iy * dimensions.x;
-            // ignore novalue cells
-            if (height_map[cell_idx] < 0.0f) {
-                continue;
-            }
+void SimulationData::mapTopography(const Array2D<float, CellLayout>& height_map,
+                                   const Array2D<int32_t, CellLayout>& neighbours,
+                                   const Array2D<float, CellLayout>& flow_coefficients) {
+    this->height_map = height_map;
+    this->neighbours = neighbours;
+    this->flow_coefficients = flow_coefficients;
+}
 
-            // find steepest neighbour
-            cells[cell_idx] = Cell(ix, iy);
-            size_t lowest_neighbour_idx = 0;
-            float lowest_gradient = 0;
-            for (int ny = std::max(0, iy - 1);
-                 ny < std::min(iy + 2, (int)height_map.height);
-                 ++ny) {
-                for (int nx = std::max(0, ix - 1);
-                     nx < std::min(ix + 2, (int)height_map.width);
-                     ++nx) {
-                    if (iy == ny && ix == nx) {
-                        continue;
-                    }
+void SimulationData::allocateTile(const size_t& tile) {
+    std::lock_guard<std::mutex> lock(tile_mutex);
+    if (tile_chunk_used == tile_chunk_size) {
+        tile_chunks.push_back(allocateGrid<HydraulicTile>(tile_chunk_size, memory));
+        tile_chunk_used = 0;
+    }
+    hydraulic_tiles[tile] = &tile_chunks.back()[tile_chunk_used++];
+    wet_tiles.push_back(tile);
+}
 
-                    size_t neighbor_idx = nx + ny * dimensions.x;
-                    if (height_map[neighbor_idx] < 0.0f) {
-                        continue;
-                    }
+namespace {
+
+// the 8 neighbours in row-major order with 1 / distance; cell_offset is the
+// difference of the tiled indices inside a tile
+struct NeighbourOffset {
+    int dx;
+    int dy;
+    float inv_distance;
+    ptrdiff_t cell_offset;
+};
+constexpr float inv_sqrt2 = 0.70710678118654752f;
+constexpr ptrdiff_t tile_row = tile_size;
+constexpr NeighbourOffset neighbour_offsets[8] = {{-1, -1, inv_sqrt2, -tile_row - 1},
+                                                  {0, -1, 1.f, -tile_row},
+                                                  {1, -1, inv_sqrt2, -tile_row + 1},
+                                                  {-1, 0, 1.f, -1},
+                                                  {1, 0, 1.f, 1},
+                                                  {-1, 1, inv_sqrt2, tile_row - 1},
+                                                  {0, 1, 1.f, tile_row},
+                                                  {1, 1, inv_sqrt2, tile_row + 1}};
+
+// not on the border of its tile, all neighbours are in the same tile
+bool innerCell(const size_t& idx) {
+    size_t x = idx & (tile_size - 1);
+    size_t y = (idx >> tile_bits) & (tile_size - 1);
+    return x - 1 < tile_size - 2 && y - 1 < tile_size - 2;
+}
 
-                    float gradient = cellGradient(neighbor_idx, cell_idx) /
-                                     sqrtf((ix - nx) * (ix - nx) + (iy - ny) * (iy - ny));
+}  // namespace
 
-                    // if (gradient >= 0.f) {
-                    //     cells[cell_idx].higher_neigbours.push_back(neighbor_idx);
-                    // }
+void SimulationData::findNeighbours() { findNeighbours(0, dimensions.y); }
 
-                    if (gradient < lowest_gradient) {
-                        lowest_gradient = gradient;
-                        lowest_neighbour_idx = neighbor_idx;
-                    }
+void SimulationData::findNeighbours(ThreadPool& pool) {
+    findNeighbours(0, dimensions.y, pool);
+}
+
+void SimulationData::findNeighbours(const size_t& row_begin,
+                                    const size_t& row_end,
+                                    ThreadPool& pool) {
+    // steepest descent is purely local, every thread takes a band of rows
+    pool.parallelFor(row_end - row_begin, [&](size_t begin, size_t end, size_t) {
+        findNeighbours(row_begin + begin, row_begin + end);
+    });
+}
+
+void SimulationData::findNeighbours(const size_t& row_begin, const size_t& row_end) {
+    const int width = dimensions.x;
+    const int height = dimensions.y;
+    // tile by tile, the last band also takes the padding rows of the border tiles
+    const size_t padded_row_end =
+        row_end == dimensions.y ? grid.tiles_y * tile_size : row_end;
+    neighbours.forEachCell(row_begin, padded_row_end, [&](int ix, int iy, size_t idx) {
+        neighbours[idx] = -1;
+        flow_coefficients[idx] = 0.f;
+        // ignore padding and novalue cells
+        if (ix >= width || iy >= height) {
+            return;
+        }
+        float cell_height = height_map[idx];
+        if (cell_height < 0.0f) {
+            return;
+        }
+        // neighbours in the same tile and inside the raster, the usual case
+        const bool inner = innerCell(idx) && ix + 1 < width && iy + 1 < height;
+
+        // find steepest neighbour, the gradient is weighted with 1 / distance^2
+        const NeighbourOffset* lowest_offset = nullptr;
+        float lowest_gradient = 0;
+        for (const NeighbourOffset& offset : neighbour_offsets) {
+            float neighbor_height;
+            if (inner) {
+                neighbor_height = height_map[idx + offset.cell_offset];
+            } else {
+                int nx = ix + offset.dx;
+                int ny = iy + offset.dy;
+                if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+                    continue;
                 }
+                neighbor_height = height_map[neighbours.idx(nx, ny)];
+            }
+            if (neighbor_height < 0.0f) {
+                continue;
             }
 
-            // was a neighbour found?
-            if (lowest_gradient < 0.0f) {
-                cells[cell_idx].neighbor = lowest_neighbour_idx;
+            float gradient = (neighbor_height - cell_height) * offset.inv_distance *
+                             offset.inv_distance;
+            if (gradient < lowest_gradient) {
+                lowest_gradient = gradient;
+                lowest_offset = &offset;
             }
-            // std::sort(cells[cell_idx].higher_neigbours.begin(),
-            //           cells[cell_idx].higher_neigbours.end(),
-            //           [&](const size_t& idx_1, const size_t& idx_2) {
-            //               return height_map[idx_1] < height_map[idx_2];
-            //           });
         }
-    }
+
+        // was a neighbour found?
+        if (lowest_gradient < 0.0f) {
+            int nx = ix + lowest_offset->dx;
+            int ny = iy + lowest_offset->dy;
+            neighbours[idx] = neighbours.idx(nx, ny);
+            float slope =
+                (cell_height - height_map[neighbours[idx]]) * lowest_offset->inv_distance;
+            flow_coefficients[idx] = sqrtf(slope) * lowest_offset->inv_distance;
+        }
+    });
+}
+
+void SimulationData::findFlowWeights(ThreadPool& pool) {
+    // share of a lower neighbour: (slope * contour length)^1.1 (Freeman 1991, with
+    // the contour lengths of Quinn et al. 1991), rounded to 1/255
+    constexpr float exponent = 1.1f;
+    constexpr float cardinal_length = 0.5f;
+    constexpr float diagonal_length = 0.354f;
+    const int width = dimensions.x;
+    const int height = dimensions.y;
+    flow_weights = gridArray<uint64_t, CellLayout>(width, height, memory);  // zeroed
+    pool.parallelFor(height, [&](size_t row_begin, size_t row_end, size_t) {
+        flow_weights.forEachCell(row_begin, row_end, [&](int ix, int iy, size_t idx) {
+            // padding stays 0
+            if (ix >= width || height_map[idx] < 0.0f) {
+                return;
+            }
+            float cell_height = height_map[idx];
+            const bool inner = innerCell(idx) && ix + 1 < width && iy + 1 < height;
+
+            float shares[8] = {};
+            float sum = 0.f;
+            for (size_t d = 0; d < 8; ++d) {
+                const NeighbourOffset& offset = neighbour_offsets[d];
+                float neighbor_height;
+                if (inner) {
+                    neighbor_height = height_map[idx + offset.cell_offset];
+                } else {
+                    int nx = ix + offset.dx;
+                    int ny = iy + offset.dy;
+                    if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+                        continue;
+                    }
+                    neighbor_height = height_map[flow_weights.idx(nx, ny)];
+                }
+                if (neighbor_height < 0.0f || neighbor_height >= cell_height) {
+                    continue;
+                }
+                float length = offset.inv_distance < 1.f ? diagonal_length
+                                                         : cardinal_length;
+                shares[d] = powf(
+                    (cell_height - neighbor_height) * offset.inv_distance * length,
+                    exponent);
+                sum += shares[d];
+            }
+            if (!(sum > 0.f)) {
+                return;
+            }
+
+            // rounding leftovers go to the largest share, so the bytes add up
+            // to 255 exactly
+            uint8_t bytes[8];
+            int total = 0;
+            size_t largest = 0;
+            for (size_t d = 0; d < 8; ++d) {
+                bytes[d] = uint8_t(shares[d] / sum * 255.f + 0.5f);
+                total += bytes[d];
+                if (shares[d] > shares[largest]) {
+                    largest = d;
+                }
+            }
+            bytes[largest] += 255 - total;
+            uint64_t weights = 0;
+            for (size_t d = 0; d < 8; ++d) {
+                weights |= uint64_t(bytes[d]) << (8 * d);
+            }
+            flow_weights[idx] = weights;
+        });
+    });
 }
 
 float SimulationData::cellDistance(const size_t& cell_idx1,
                                    const size_t& cell_idx2) const {
-    const Cell& c1 = cells[cell_idx1];
-    const Cell& c2 = cells[cell_idx2];
+    Vec2ui c1 = cellCoords(cell_idx1);
+    Vec2ui c2 = cellCoords(cell_idx2);
     return sqrtf((c1.x - c2.x) * (c1.x - c2.x) + (c1.y - c2.y) * (c1.y - c2.y));
 }
 
 float SimulationData::cellGradient(const size_t& cell_idx1,
                                    const size_t& cell_idx2) const {
-    const Cell& c1 = cells[cell_idx1];
-    const Cell& c2 = cells[cell_idx2];
-    return (height_map[cell_idx1] - height_map[cell_idx2]) /
+    Vec2ui c1 = cellCoords(cell_idx1);
+    Vec2ui c2 = cellCoords(cell_idx2);
+    return (cellHeight(cell_idx1) - cellHeight(cell_idx2)) /
            sqrtf((c1.x - c2.x) * (c1.x - c2.x) + (c1.y - c2.y) * (c1.y - c2.y));
 }
 
-void SimulationData::sweepCellsWithWater() {
-    cells_with_water.clear();
-    for (int y = 0; y < dimensions.y; ++y) {
-        for (int x = 0; x < dimensions.x; ++x) {
-            size_t idx = x + y * dimensions.x;
-            if (height_map[idx] < 0.f) {
-                continue;
-            }
-            if (cells[idx].water_level > 0.f) {
-                cells_with_water.push_back(idx);
-            }
-        }
+void SimulationData::setWaterLevel(const size_t& cell_idx, const float& amount) {
+    if (activate(cell_idx)) {
+        cells_with_water.push_back(cell_idx);
     }
+    waterLevel(cell_idx) = amount;
 }
 
-void SimulationData::setWaterLevel(const size_t& cell_idx, const float& amount) {
-    Cell& c = cells[cell_idx];
-    c.water_level = amount;
-    if (!c.active) {
-        c.active = true;
+void SimulationData::modifyWaterLevel(const size_t& cell_idx, const float& amount) {
+    if (activate(cell_idx)) {
         cells_with_water.push_back(cell_idx);
     }
+    waterLevel(cell_idx) += amount;
 }
 
-void SimulationData::modifyWaterLevel(const size_t& cell_idx, const float& amount) {
-    Cell& c = cells[cell_idx];
-    c.water_level += amount;
-    if (!c.active) {
-        c.active = true;
+void SimulationData::modifyWaterLevelChange(const size_t& cell_idx,
+                                            const float& amount) {
+    if (activate(cell_idx)) {
         cells_with_water.push_back(cell_idx);
     }
+    waterLevelChange(cell_idx) += amount;
 }
 
 }  // namespace gbhs
@@ -1,8 +1,14 @@
 #ifndef EXDIMUM_SIMULATION_DATA_H
 #define EXDIMUM_SIMULATION_DATA_H
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+#include "grid_memory.hpp"
+#include "thread_pool.hpp"
+#include "tiles.hpp"
 #include "utils.hpp"
 
 namespace gbhs {
@@ -13,46 +19,173 @@ struct SimulationSettings {
     int32_t width = 23558;
     int32_t height = 20000;
     float dt = 0.1f;                 // [sec]
-    size_t output_resolution = 150;  // [steps]
-};
-
-// TODO only create these information when cell has water in it
-struct Cell {
-    uint32_t x = 0;
-    uint32_t y = 0;
-    float water_level = 0.0f;
-    float water_level_change = 0.0f;
-    int32_t neighbor = -1;
-    // std::vector<size_t> neighbours = {};
-    // std::vector<size_t> higher_neigbours = {};  // sorted
-    bool active = false;
-
-    Cell() = default;
-    Cell(const size_t& x, const size_t& y) : x(x), y(y) {}
+    bool fill_depressions = true;    // see depression_filling.hpp
+    bool multi_flow = false;         // split the outflow, see findFlowWeights
+    size_t output_resolution = 150;  // [steps], output every output_resolution * dt
+    // adaptive time stepping: every step takes the largest stable dt up to max_dt
+    bool adaptive_dt = false;
+    float max_dt = 5.f;  // [sec]
+    // local time stepping on top of adaptive dt, tiles take up to 2^max_local_level
+    // substeps of a step, see local_stepping.hpp
+    bool local_dt = false;
+    size_t max_local_level = 4;
+    GridMemory memory;  // page size and NUMA placement of the grid arrays
+    size_t steal_grain = 1;  // see Manning::setStealGrain
 };
 
 // TODO rework & visibility
+// cells are addressed by their tiled index (see tiles.hpp), the height map included
 class SimulationData {
    public:
-    SimulationData(const size_t& width, const size_t& height);
+    // throws std::length_error if the grid doesn't fit, see fits()
+    SimulationData(const size_t& width,
+                   const size_t& height,
+                   const GridMemory& memory = GridMemory());
+    // downstream neighbours are int32 tiled indices, so the padded cell count of the
+    // grid has to stay below 2^31
+    static bool fits(const size_t& width, const size_t& height) {
+        return TileGrid(width, height).cellCount() <= size_t(INT32_MAX);
+    }
 
     void findNeighbours();
+    // only rows [row_begin, row_end), the height map has to be loaded one row beyond
+    void findNeighbours(const size_t& row_begin, const size_t& row_end);
+    void findNeighbours(ThreadPool& pool);
+    void findNeighbours(const size_t& row_begin, const size_t& row_end, ThreadPool& pool);
+    // multi-flow-direction weights from the height map, see flowWeights(); only
+    // needs the height map, so it also works on topography from a cache
+    void findFlowWeights(ThreadPool& pool);
+    // results of findNeighbours, e.g. for a cache
+    const Array2D<int32_t, CellLayout>& neighbourMap() const { return neighbours; }
+    const Array2D<float, CellLayout>& flowCoefficientMap() const {
+        return flow_coefficients;
+    }
+    // replaces the height map and the results of findNeighbours, see raster_cache.hpp
+    void mapTopography(const Array2D<float, CellLayout>& height_map,
+                       const Array2D<int32_t, CellLayout>& neighbours,
+                       const Array2D<float, CellLayout>& flow_coefficients);
     void setWaterLevel(const size_t& cell_idx, const float& amount);
     void modifyWaterLevel(const size_t& cell_idx, const float& amount);
-    void sweepCellsWithWater();
-    size_t cellCount() const { return cells.size(); }
-    const Cell& getCell(const size_t& idx) const { return cells[idx]; }
-    Cell& getCell(const size_t& idx) { return cells[idx]; }  // TODO const
+    // the next apply of a step adds the change to the level, see Manning
+    void modifyWaterLevelChange(const size_t& cell_idx, const float& amount);
+    size_t cellCount() const { return grid.cellCount(); }
+    const TileGrid& tileGrid() const { return grid; }
+    size_t cellIndex(const size_t& x, const size_t& y) const { return grid.idx(x, y); }
+    Vec2ui cellCoords(const size_t& idx) const { return grid.coords(idx); }
+    size_t rasterIndex(const size_t& idx) const {
+        Vec2ui c = grid.coords(idx);
+        return c.x + c.y * dimensions.x;
+    }
+    float cellHeight(const size_t& idx) const { return height_map[idx]; }
     float cellGradient(const size_t& cell_idx1, const size_t& cell_idx2) const;
     float cellDistance(const size_t& cell_idx1, const size_t& cell_idx2) const;
     std::vector<size_t>& cellsWithWater() { return cells_with_water; }
 
-    Array2D<float> height_map;  // TODO visibility
+    // per cell state (structure of arrays); water level and change only exist for
+    // tiles that have ever been wet, so accessing them requires hasWaterState()
+    bool hasWaterState(const size_t& idx) const {
+        return hydraulic_tiles[idx >> tile_cell_bits] != nullptr;
+    }
+    float& waterLevel(const size_t& idx) {
+        return hydraulic_tiles[idx >> tile_cell_bits]
+            ->water_level[idx & (tile_cells - 1)];
+    }
+    float& waterLevelChange(const size_t& idx) {
+        return hydraulic_tiles[idx >> tile_cell_bits]
+            ->water_level_change[idx & (tile_cells - 1)];
+    }
+    HydraulicTile* const* hydraulicTiles() const { return hydraulic_tiles.data(); }
+    // tiles with water state in the order they were allocated
+    const std::vector<size_t>& wetTiles() const { return wet_tiles; }
+    int32_t neighbor(const size_t& idx) const { return neighbours[idx]; }
+    // sqrt(slope) / distance towards the downstream cell
+    float flowCoefficient(const size_t& idx) const { return flow_coefficients[idx]; }
+    // multi-flow-direction: byte d is the share of the outflow in 1/255 that goes to
+    // direction d (see neighbourIndex), they add up to 255 for cells with a neighbor;
+    // only after findFlowWeights
+    bool multiFlow() const { return flow_weights.size() != 0; }
+    uint64_t flowWeights(const size_t& idx) const { return flow_weights[idx]; }
+    // cell next to idx in direction d, the 8 neighbours in row-major order; has to lie
+    // inside the padded grid
+    size_t neighbourIndex(const size_t& idx, const size_t& d) const {
+        constexpr int dx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+        constexpr int dy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+        size_t tile = idx >> tile_cell_bits;
+        int x = int(idx & (tile_size - 1)) + dx[d];
+        int y = int((idx >> tile_bits) & (tile_size - 1)) + dy[d];
+        if (x < 0) {
+            tile -= 1;
+        } else if (x >= int(tile_size)) {
+            tile += 1;
+        }
+        if (y < 0) {
+            tile -= grid.tiles_x;
+        } else if (y >= int(tile_size)) {
+            tile += grid.tiles_x;
+        }
+        return (tile << tile_cell_bits) | ((y & (tile_size - 1)) << tile_bits) |
+               (x & (tile_size - 1));
+    }
+    bool isActive(const size_t& idx) const {
+        return (active[idx >> 6] >> (idx & 63)) & 1u;
+    }
+    // returns false if the cell was already active; allocates the water state of the
+    // tile, concurrent calls have to be for cells of different tiles
+    bool activate(const size_t& idx) {
+        uint64_t bit = uint64_t(1) << (idx & 63);
+        if (active[idx >> 6] & bit) {
+            return false;
+        }
+        active[idx >> 6] |= bit;
+        if (!hasWaterState(idx)) {
+            allocateTile(idx >> tile_cell_bits);
+        }
+        return true;
+    }
+    // activates the cells row_idx + i for the bits i set in mask, row_idx is the first
+    // cell of a tile row (one word of the bitset); returns the bits of the cells that
+    // were not active yet, the caller has to append those to cellsWithWater()
+    uint64_t activateRow(const size_t& row_idx, const uint64_t& mask) {
+        uint64_t& word = active[row_idx >> 6];
+        uint64_t new_cells = mask & ~word;
+        word |= mask;
+        if (new_cells != 0 && !hasWaterState(row_idx)) {
+            allocateTile(row_idx >> tile_cell_bits);
+        }
+        return new_cells;
+    }
+    // may be called concurrently, the caller also has to remove idx from
+    // cellsWithWater()
+    void deactivate(const size_t& idx) {
+        __atomic_fetch_and(
+            &active[idx >> 6], ~(uint64_t(1) << (idx & 63)), __ATOMIC_RELAXED);
+    }
+
+    Array2D<float, CellLayout> height_map;  // TODO visibility
     Vec2ui dimensions;
 
    private:
-    Array2D<Cell> cells;
-    std::vector<size_t> cells_with_water;  // store idx of cell in cells array
+    void allocateTile(const size_t& tile);
+
+    TileGrid grid;
+    GridMemory memory;
+    std::vector<HydraulicTile*> hydraulic_tiles;  // nullptr for tiles that never were wet
+    std::vector<size_t> wet_tiles;
+    // tile pool, HydraulicTiles are handed out from chunks of tile_chunk_size (2 MB,
+    // one huge page); a tile's pages are placed by the thread that steps it first
+    static constexpr size_t tile_chunk_size = 64;
+    std::vector<std::shared_ptr<HydraulicTile[]>> tile_chunks;
+    size_t tile_chunk_used = tile_chunk_size;
+    std::mutex tile_mutex;
+
+    // tiled index, padding included
+    Array2D<int32_t, CellLayout> neighbours;  // downstream cell, -1 if there is none
+    Array2D<float, CellLayout> flow_coefficients;
+    Array2D<uint64_t, CellLayout> flow_weights;  // empty without findFlowWeights
+    std::vector<uint64_t> active;  // bitset, one bit per cell
+    // active cells, each step drops dry ones; Manning keeps it close to index order,
+    // so sweeping it follows the tiled storage
+    std::vector<size_t> cells_with_water;
 };
 
 }  // namespace gbhs
@@ -0,0 +1,227 @@
+#include "snapshot_format.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "little_endian.hpp"
+#include "lz4_block.hpp"
+
+namespace gbhs {
+
+namespace {
+
+constexpr char snapshot_magic[8] = {'G', 'B', 'H', 'S', 'S', 'N', 'A', 'P'};
+constexpr char index_magic[4] = {'G', 'B', 'H', 'I'};
+
+// 7 bits per byte, high bit set on all but the last byte
+void putVarint(std::vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (b < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+SnapshotEncoder::SnapshotEncoder(const Vec2ui& dimensions, const float& precision)
+    : dimensions(dimensions),
+      tiles_x((dimensions.x + snapshot_tile_size - 1) / snapshot_tile_size),
+      inv_precision(1.f / precision),
+      precision(precision) {}
+
+const std::vector<uint8_t>& SnapshotEncoder::encode(const OutputCell* cells,
+                                                    const size_t& count) {
+    // group the cells by tile, row-major inside a tile, so the index deltas are small
+    sorted.resize(count);
+    for (size_t k = 0; k < count; ++k) {
+        size_t x = cells[k].idx % dimensions.x;
+        size_t y = cells[k].idx / dimensions.x;
+        uint64_t tile = x / snapshot_tile_size + y / snapshot_tile_size * tiles_x;
+        uint64_t local =
+            x % snapshot_tile_size + y % snapshot_tile_size * snapshot_tile_size;
+        float level = std::max(0.f, cells[k].water_level) * inv_precision + 0.5f;
+        sorted[k] = {tile << 32 | local, (uint32_t)level};
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const SortedCell& a, const SortedCell& b) {
+        return a.key < b.key;
+    });
+
+    encoded.assign(snapshot_header_size, 0);
+    blocks.clear();
+    for (size_t begin = 0; begin < count;) {
+        uint32_t tile = sorted[begin].key >> 32;
+        size_t end = begin;
+        while (end < count && (sorted[end].key >> 32) == tile) {
+            ++end;
+        }
+
+        // index deltas first, then the levels, similar values compress better together
+        raw.clear();
+        uint32_t previous = 0;
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t local = (uint32_t)sorted[k].key;
+            putVarint(raw, local - previous);
+            previous = local;
+        }
+        for (size_t k = begin; k < end; ++k) {
+            putVarint(raw, sorted[k].level);
+        }
+
+        SnapshotBlock block{tile, (uint32_t)(end - begin), encoded.size(), 0,
+                            (uint32_t)raw.size()};
+        encoded.resize(block.offset + lz4CompressBound(raw.size()));
+        block.compressed_size =
+            lz4Compress(raw.data(), raw.size(), &encoded[block.offset]);
+        if (block.compressed_size >= raw.size()) {
+            // incompressible, stored as is
+            std::memcpy(&encoded[block.offset], raw.data(), raw.size());
+            block.compressed_size = raw.size();
+        }
+        encoded.resize(block.offset + block.compressed_size);
+        blocks.push_back(block);
+        begin = end;
+    }
+
+    uint8_t* header = encoded.data();
+    std::memcpy(header, snapshot_magic, sizeof(snapshot_magic));
+    putU32(header + 8, snapshot_version);
+    putU32(header + 12, dimensions.x);
+    putU32(header + 16, dimensions.y);
+    putU32(header + 20, snapshot_tile_size);
+    putF32(header + 24, precision);
+    putU32(header + 28, count);
+
+    uint64_t index_offset = encoded.size();
+    encoded.resize(index_offset + snapshot_block_entry_size * blocks.size() +
+                   snapshot_trailer_size);
+    uint8_t* p = &encoded[index_offset];
+    for (const SnapshotBlock& block : blocks) {
+        putU32(p, block.tile);
+        putU32(p + 4, block.cell_count);
+        putU64(p + 8, block.offset);
+        putU32(p + 16, block.compressed_size);
+        putU32(p + 20, block.raw_size);
+        p += snapshot_block_entry_size;
+    }
+    putU64(p, index_offset);
+    putU32(p + 8, blocks.size());
+    std::memcpy(p + 12, index_magic, sizeof(index_magic));
+    return encoded;
+}
+
+bool SnapshotReader::open(const uint8_t* data, const size_t& size) {
+    block_index.clear();
+    if (size < snapshot_header_size + snapshot_trailer_size ||
+        std::memcmp(data, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+        getU32(data + 8) != snapshot_version) {
+        return false;
+    }
+    this->data = data;
+    this->size = size;
+    width = getU32(data + 12);
+    height = getU32(data + 16);
+    tile_size = getU32(data + 20);
+    level_precision = getF32(data + 24);
+    cell_count = getU32(data + 28);
+    if (tile_size == 0 || width == 0) {
+        return false;
+    }
+
+    // the index is found through the trailer at the very end
+    const uint8_t* trailer = data + size - snapshot_trailer_size;
+    uint64_t index_offset = getU64(trailer);
+    uint64_t block_count = getU32(trailer + 8);
+    if (std::memcmp(trailer + 12, index_magic, sizeof(index_magic)) != 0 ||
+        index_offset < snapshot_header_size ||
+        index_offset + snapshot_block_entry_size * block_count !=
+            size - snapshot_trailer_size) {
+        return false;
+    }
+    const uint8_t* p = data + index_offset;
+    for (size_t i = 0; i < block_count; ++i, p += snapshot_block_entry_size) {
+        SnapshotBlock block{getU32(p), getU32(p + 4), getU64(p + 8), getU32(p + 16),
+                            getU32(p + 20)};
+        if (block.offset + block.compressed_size > index_offset) {
+            return false;
+        }
+        block_index.push_back(block);
+    }
+    return true;
+}
+
+bool SnapshotReader::readBlock(const SnapshotBlock& block,
+                               std::vector<OutputCell>& cells) const {
+    const uint8_t* begin = data + block.offset;
+    if (block.compressed_size != block.raw_size) {
+        raw.resize(block.raw_size);
+        if (!lz4Decompress(begin, block.compressed_size, raw.data(), raw.size())) {
+            return false;
+        }
+        begin = raw.data();
+    }
+    const uint8_t* p = begin;
+    const uint8_t* end = begin + block.raw_size;
+
+    const size_t tiles_x = (width + tile_size - 1) / tile_size;
+    const size_t origin_x = block.tile % tiles_x * tile_size;
+    const size_t origin_y = block.tile / tiles_x * tile_size;
+    const size_t first = cells.size();
+    uint32_t local = 0;
+    for (size_t k = 0; k < block.cell_count; ++k) {
+        uint32_t delta;
+        if (!getVarint(p, end, delta)) {
+            return false;
+        }
+        local += delta;
+        if (local >= tile_size * tile_size) {
+            return false;
+        }
+        size_t x = origin_x + local % tile_size;
+        size_t y = origin_y + local / tile_size;
+        cells.push_back({(uint32_t)(x + y * width), 0.f});
+    }
+    for (size_t k = 0; k < block.cell_count; ++k) {
+        uint32_t level;
+        if (!getVarint(p, end, level)) {
+            return false;
+        }
+        cells[first + k].water_level = level * level_precision;
+    }
+    return p == end;
+}
+
+bool SnapshotReader::readAll(std::vector<OutputCell>& cells) const {
+    cells.reserve(cells.size() + cell_count);
+    for (const SnapshotBlock& block : block_index) {
+        if (!readBlock(block, cells)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const SnapshotBlock* SnapshotReader::findTile(const size_t& tile_x,
+                                              const size_t& tile_y) const {
+    // blocks are sorted by tile
+    const size_t tiles_x = (width + tile_size - 1) / tile_size;
+    uint32_t tile = tile_x + tile_y * tiles_x;
+    auto it = std::lower_bound(
+        block_index.begin(), block_index.end(), tile,
+        [](const SnapshotBlock& block, const uint32_t& t) { return block.tile < t; });
+    return it != block_index.end() && it->tile == tile ? &*it : nullptr;
+}
+
+}  // namespace gbhs
@@ -0,0 +1,90 @@
+#ifndef EXDIMUM_SNAPSHOT_FORMAT_H
+#define EXDIMUM_SNAPSHOT_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace gbhs {
+
+// step snapshot, little-endian on every platform (see README):
+// header, one lz4 block per spatial tile with wet cells, block index, trailer
+constexpr uint32_t snapshot_version = 1;
+constexpr uint32_t snapshot_tile_size = 256;  // [cells], tiles of the raster
+constexpr size_t snapshot_header_size = 32;
+constexpr size_t snapshot_block_entry_size = 24;
+constexpr size_t snapshot_trailer_size = 16;
+
+// raster index of a wet cell and its water level
+struct OutputCell {
+    uint32_t idx;
+    float water_level;
+};
+
+// one entry of the block index
+struct SnapshotBlock {
+    uint32_t tile;  // tile x + tile y * tiles in x
+    uint32_t cell_count;
+    uint64_t offset;  // from the start of the snapshot
+    uint32_t compressed_size;  // equal to raw_size if stored uncompressed
+    uint32_t raw_size;
+};
+
+// water levels are stored as multiples of precision [m], so the encoding is lossy
+class SnapshotEncoder {
+   public:
+    SnapshotEncoder(const Vec2ui& dimensions, const float& precision);
+
+    // the result is valid until the next call
+    const std::vector<uint8_t>& encode(const OutputCell* cells, const size_t& count);
+
+   private:
+    struct SortedCell {
+        uint64_t key;  // tile << 32 | index inside the tile
+        uint32_t level;  // quantized
+    };
+
+    Vec2ui dimensions;
+    size_t tiles_x;
+    float inv_precision;
+    float precision;
+    std::vector<SortedCell> sorted;
+    std::vector<uint8_t> raw;
+    std::vector<SnapshotBlock> blocks;
+    std::vector<uint8_t> encoded;
+};
+
+// reads a snapshot from memory, e.g. a step chunk of a mapped output container
+class SnapshotReader {
+   public:
+    // false if the data isn't a snapshot of a supported version
+    bool open(const uint8_t* data, const size_t& size);
+
+    // appends the cells of one block
+    bool readBlock(const SnapshotBlock& block, std::vector<OutputCell>& cells) const;
+    bool readAll(std::vector<OutputCell>& cells) const;
+    // nullptr if the tile has no wet cells
+    const SnapshotBlock* findTile(const size_t& tile_x, const size_t& tile_y) const;
+
+    const std::vector<SnapshotBlock>& blocks() const { return block_index; }
+    Vec2ui dimensions() const { return {width, height}; }
+    size_t cellCount() const { return cell_count; }
+    float precision() const { return level_precision; }
+
+   private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t width = 0;
+    size_t height = 0;
+    size_t tile_size = 0;
+    size_t cell_count = 0;
+    float level_precision = 0.f;
+    std::vector<SnapshotBlock> block_index;
+    mutable std::vector<uint8_t> raw;
+};
+
+}  // namespace gbhs
+
+#endif
@@ -0,0 +1,81 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace gbhs {
+
+ThreadPool::ThreadPool(const size_t& thread_count) {
+    for (size_t i = 1; i < std::max<size_t>(1, thread_count); ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::run(const std::function<void(size_t)>& fn) {
+    if (workers.empty()) {
+        fn(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &fn;
+        pending = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+    fn(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == 0; });
+    task = nullptr;
+}
+
+void ThreadPool::parallelFor(const size_t& n,
+                             const std::function<void(size_t, size_t, size_t)>& fn) {
+    const size_t chunk = (n + size() - 1) / size();
+    run([&](size_t thread_idx) {
+        size_t begin = std::min(n, thread_idx * chunk);
+        size_t end = std::min(n, begin + chunk);
+        if (begin < end) {
+            fn(begin, end, thread_idx);
+        }
+    });
+}
+
+void ThreadPool::workerLoop(const size_t& thread_idx) {
+    size_t seen_generation = 0;
+    while (true) {
+        const std::function<void(size_t)>* fn = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stop || generation != seen_generation; });
+            if (stop) {
+                return;
+            }
+            seen_generation = generation;
+            fn = task;
+        }
+
+        (*fn)(thread_idx);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) {
+                done.notify_one();
+            }
+        }
+    }
+}
+
+}  // namespace gbhs
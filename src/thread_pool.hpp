@@ -0,0 +1,44 @@
+#ifndef EXDIMUM_THREAD_POOL_H
+#define EXDIMUM_THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gbhs {
+
+// fixed size pool; the calling thread takes part as thread 0
+class ThreadPool {
+   public:
+    explicit ThreadPool(const size_t& thread_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size() + 1; }
+
+    // calls fn(thread_idx) once on every thread and blocks until all returned
+    void run(const std::function<void(size_t)>& fn);
+
+    // splits [0, n) into size() contiguous chunks: fn(begin, end, thread_idx)
+    void parallelFor(const size_t& n,
+                     const std::function<void(size_t, size_t, size_t)>& fn);
+
+   private:
+    void workerLoop(const size_t& thread_idx);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* task = nullptr;
+    size_t generation = 0;
+    size_t pending = 0;
+    bool stop = false;
+};
+
+}  // namespace gbhs
+
+#endif
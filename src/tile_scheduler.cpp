@@ -0,0 +1,112 @@
+#include "tile_scheduler.hpp"
+
+#include <algorithm>
+
+namespace gbhs {
+
+namespace {
+
+uint64_t pack(const size_t& begin, const size_t& end) {
+    return uint64_t(begin) | (uint64_t(end) << 32);
+}
+
+}  // namespace
+
+TileScheduler::TileScheduler(ThreadPool& pool) : pool(pool), runs(pool.size()) {}
+
+bool TileScheduler::popFront(Run& run, size_t& task) {
+    uint64_t tasks = run.tasks.load(std::memory_order_relaxed);
+    while (true) {
+        size_t begin = tasks & 0xffffffffu;
+        size_t end = tasks >> 32;
+        if (begin >= end) {
+            return false;
+        }
+        if (run.tasks.compare_exchange_weak(
+                tasks, pack(begin + 1, end), std::memory_order_acq_rel)) {
+            task = begin;
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::stealBack(Run& run, size_t& begin, size_t& end) {
+    uint64_t tasks = run.tasks.load(std::memory_order_relaxed);
+    while (true) {
+        size_t run_begin = tasks & 0xffffffffu;
+        size_t run_end = tasks >> 32;
+        // the owner keeps its next task
+        if (run_end <= run_begin + 1) {
+            return false;
+        }
+        size_t grain = std::min(steal_grain, (run_end - run_begin) / 2);
+        if (run.tasks.compare_exchange_weak(
+                tasks, pack(run_begin, run_end - grain), std::memory_order_acq_rel)) {
+            begin = run_end - grain;
+            end = run_end;
+            return true;
+        }
+    }
+}
+
+void TileScheduler::run(const std::vector<size_t>& weights,
+                        const std::function<void(size_t, size_t)>& fn) {
+    // contiguous runs of about total / threads, a run ends once it got its share
+    const size_t threads = pool.size();
+    size_t total = 0;
+    for (const size_t& weight : weights) {
+        total += weight;
+    }
+    size_t task = 0;
+    size_t weight_sum = 0;
+    for (size_t thread = 0; thread < threads; ++thread) {
+        size_t begin = task;
+        size_t share_end = total / threads * (thread + 1);
+        while (task < weights.size() &&
+               (thread + 1 == threads || weight_sum + weights[task] / 2 < share_end)) {
+            weight_sum += weights[task++];
+        }
+        runs[thread].tasks.store(pack(begin, task), std::memory_order_relaxed);
+    }
+
+    std::atomic<size_t> steals{0};
+    pool.run([&](size_t thread_idx) {
+        size_t own;
+        while (popFront(runs[thread_idx], own)) {
+            fn(own, thread_idx);
+        }
+
+        // steal from the run with the most tasks left until all are taken
+        while (true) {
+            size_t victim = threads;
+            size_t most = 0;
+            for (size_t t = 0; t < threads; ++t) {
+                uint64_t tasks = runs[t].tasks.load(std::memory_order_relaxed);
+                size_t left = (tasks >> 32) - std::min(tasks >> 32, tasks & 0xffffffffu);
+                if (left > most) {
+                    most = left;
+                    victim = t;
+                }
+            }
+            if (victim == threads) {
+                return;
+            }
+            size_t begin;
+            size_t end;
+            if (!stealBack(runs[victim], begin, end)) {
+                // its last task: whoever gets it first
+                if (popFront(runs[victim], begin)) {
+                    fn(begin, thread_idx);
+                }
+                continue;
+            }
+            steals.fetch_add(1, std::memory_order_relaxed);
+            for (size_t t = begin; t < end; ++t) {
+                fn(t, thread_idx);
+            }
+        }
+    });
+    steal_count = steals.load();
+}
+
+}  // namespace gbhs
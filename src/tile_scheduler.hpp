@@ -0,0 +1,46 @@
+#ifndef EXDIMUM_TILE_SCHEDULER_H
+#define EXDIMUM_TILE_SCHEDULER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace gbhs {
+
+// runs tasks [0, n) on a pool by work stealing: every thread starts on a contiguous
+// run of tasks of about the same total weight and takes them from the front; a
+// thread that is done steals the last steal grain tasks of the heaviest other run
+class TileScheduler {
+   public:
+    explicit TileScheduler(ThreadPool& pool);
+
+    // tasks per steal, can be changed between runs
+    void setStealGrain(const size_t& grain) { steal_grain = grain > 0 ? grain : 1; }
+    size_t stealGrain() const { return steal_grain; }
+    size_t steals() const { return steal_count; }  // of the last run
+
+    // weights[t] is the expected cost of task t; fn(task, thread_idx)
+    void run(const std::vector<size_t>& weights,
+             const std::function<void(size_t, size_t)>& fn);
+
+   private:
+    // the tasks [begin, end) a thread has left, packed as begin | end << 32 so that
+    // the owner and thieves agree by a compare exchange
+    struct alignas(64) Run {
+        std::atomic<uint64_t> tasks{0};
+    };
+    bool popFront(Run& run, size_t& task);
+    bool stealBack(Run& run, size_t& begin, size_t& end);
+
+    ThreadPool& pool;
+    size_t steal_grain = 1;
+    size_t steal_count = 0;
+    std::vector<Run> runs;  // [thread]
+};
+
+}  // namespace gbhs
+
+#endif
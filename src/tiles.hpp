@@ -0,0 +1,57 @@
+#ifndef EXDIMUM_TILES_H
+#define EXDIMUM_TILES_H
+
+#include <cstddef>
+
+#include "utils.hpp"
+
+namespace gbhs {
+
+// cells are stored in square tiles of tile_size x tile_size cells; tiles are in
+// row-major order and so are the cells inside a tile:
+// cell index = tile index * tile_cells + local index
+constexpr size_t tile_bits = 6;
+constexpr size_t tile_size = size_t(1) << tile_bits;
+constexpr size_t tile_cells = tile_size * tile_size;
+constexpr size_t tile_cell_bits = 2 * tile_bits;
+// Array2D layout of per cell arrays, indexed like TileGrid::idx
+using CellLayout = TiledLayout<tile_bits>;
+
+struct TileGrid {
+    size_t width = 0;
+    size_t height = 0;
+    size_t tiles_x = 0;
+    size_t tiles_y = 0;
+
+    TileGrid() = default;
+    TileGrid(const size_t& width, const size_t& height)
+        : width(width)
+        , height(height)
+        , tiles_x((width + tile_size - 1) >> tile_bits)
+        , tiles_y((height + tile_size - 1) >> tile_bits) {}
+
+    size_t tileCount() const { return tiles_x * tiles_y; }
+    // including the padding of the tiles at the right and bottom border
+    size_t cellCount() const { return tileCount() << tile_cell_bits; }
+    size_t idx(const size_t& x, const size_t& y) const {
+        size_t tile = (y >> tile_bits) * tiles_x + (x >> tile_bits);
+        return (tile << tile_cell_bits) | ((y & (tile_size - 1)) << tile_bits) |
+               (x & (tile_size - 1));
+    }
+    Vec2ui coords(const size_t& idx) const {
+        size_t tile = idx >> tile_cell_bits;
+        size_t local = idx & (tile_cells - 1);
+        return {((tile % tiles_x) << tile_bits) | (local & (tile_size - 1)),
+                ((tile / tiles_x) << tile_bits) | (local >> tile_bits)};
+    }
+};
+
+// hydraulic state of one tile, only allocated for tiles that have ever been wet
+struct HydraulicTile {
+    float water_level[tile_cells];
+    float water_level_change[tile_cells];
+};
+
+}  // namespace gbhs
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef EXDIMUM_UTILS_H
 #define EXDIMUM_UTILS_H
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -11,7 +12,101 @@ struct Vec2ui {
     size_t y = 0;
 };
 
-template <typename T>
+// element orders of Array2D, chosen at compile time. a layout groups the storage
+// into tiles of tileWidth() x tileHeight() cells that are stored one after another,
+// tiles row after row; padded layouts store whole tiles only. local(j) is the
+// position of element j of a tile inside the tile
+
+// row after row, a tile is one row
+struct RowMajorLayout {
+    static size_t tileWidth(const size_t& width) { return width; }
+    static constexpr size_t tileHeight() { return 1; }
+    static size_t storageSize(const size_t& width, const size_t& height) {
+        return width * height;
+    }
+    static size_t idx(const size_t& x, const size_t& y, const size_t& width) {
+        return x + y * width;
+    }
+    static Vec2ui coords(const size_t& i, const size_t& width) {
+        return {i % width, i / width};
+    }
+    static Vec2ui local(const size_t& j) { return {j, 0}; }
+};
+
+// square tiles of 2^TileBits cells, rows inside a tile
+template <size_t TileBits>
+struct TiledLayout {
+    static constexpr size_t tile_size = size_t(1) << TileBits;
+
+    static constexpr size_t tileWidth(const size_t&) { return tile_size; }
+    static constexpr size_t tileHeight() { return tile_size; }
+    static size_t tilesX(const size_t& width) {
+        return (width + tile_size - 1) >> TileBits;
+    }
+    static size_t storageSize(const size_t& width, const size_t& height) {
+        return tilesX(width) * tilesX(height) << (2 * TileBits);
+    }
+    static size_t idx(const size_t& x, const size_t& y, const size_t& width) {
+        size_t tile = (y >> TileBits) * tilesX(width) + (x >> TileBits);
+        return (tile << (2 * TileBits)) | ((y & (tile_size - 1)) << TileBits) |
+               (x & (tile_size - 1));
+    }
+    static Vec2ui coords(const size_t& i, const size_t& width) {
+        size_t tile = i >> (2 * TileBits);
+        size_t local = i & (tile_size * tile_size - 1);
+        return {((tile % tilesX(width)) << TileBits) | (local & (tile_size - 1)),
+                ((tile / tilesX(width)) << TileBits) | (local >> TileBits)};
+    }
+    // coordinates of element j of a tile inside the tile
+    static Vec2ui local(const size_t& j) { return {j & (tile_size - 1), j >> TileBits}; }
+};
+
+// square tiles of 2^TileBits cells in Morton (z-)order inside a tile: the 8
+// neighbours of a cell mostly lie within a few cache lines, also vertically
+template <size_t TileBits>
+struct MortonTiledLayout {
+    static_assert(TileBits <= 16, "morton codes of a tile have to fit 32 bits");
+    static constexpr size_t tile_size = size_t(1) << TileBits;
+
+    static constexpr size_t tileWidth(const size_t&) { return tile_size; }
+    static constexpr size_t tileHeight() { return tile_size; }
+    static size_t tilesX(const size_t& width) {
+        return (width + tile_size - 1) >> TileBits;
+    }
+    static size_t storageSize(const size_t& width, const size_t& height) {
+        return tilesX(width) * tilesX(height) << (2 * TileBits);
+    }
+    // bits of v at the even positions
+    static uint32_t spread(uint32_t v) {
+        v = (v | (v << 8)) & 0x00ff00ffu;
+        v = (v | (v << 4)) & 0x0f0f0f0fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    }
+    static uint32_t compact(uint32_t v) {
+        v &= 0x55555555u;
+        v = (v | (v >> 1)) & 0x33333333u;
+        v = (v | (v >> 2)) & 0x0f0f0f0fu;
+        v = (v | (v >> 4)) & 0x00ff00ffu;
+        v = (v | (v >> 8)) & 0x0000ffffu;
+        return v;
+    }
+    static size_t idx(const size_t& x, const size_t& y, const size_t& width) {
+        size_t tile = (y >> TileBits) * tilesX(width) + (x >> TileBits);
+        return (tile << (2 * TileBits)) | spread(x & (tile_size - 1)) |
+               (spread(y & (tile_size - 1)) << 1);
+    }
+    static Vec2ui coords(const size_t& i, const size_t& width) {
+        size_t tile = i >> (2 * TileBits);
+        uint32_t local = i & (tile_size * tile_size - 1);
+        return {((tile % tilesX(width)) << TileBits) | compact(local),
+                ((tile / tilesX(width)) << TileBits) | compact(local >> 1)};
+    }
+    static Vec2ui local(const size_t& j) { return {compact(j), compact(j >> 1)}; }
+};
+
+template <typename T, typename Layout = RowMajorLayout>
 struct Array2D {
     std::shared_ptr<T[]> data;
     size_t width = 0;
@@ -20,14 +115,45 @@ struct Array2D {
     Array2D() = default;
     Array2D(const Array2D& t) = delete;  // no copy constructor for now
     Array2D(const size_t& width, const size_t& height) : width(width), height(height) {
-        data = std::shared_ptr<T[]>(new T[width * height]);
+        data = std::shared_ptr<T[]>(new T[Layout::storageSize(width, height)]);
     }
+    // wraps memory owned by someone else, e.g. a mapped file
+    Array2D(const size_t& width, const size_t& height, const std::shared_ptr<T[]>& data)
+        : data(data), width(width), height(height) {}
 
     T& operator[](const size_t& i) { return data[i]; }
     const T& operator[](const size_t& i) const { return data[i]; }
-    size_t idx(const size_t& x, const size_t& y) const { return x + y * width; }
-    size_t size() const { return width * height; }
+    size_t idx(const size_t& x, const size_t& y) const {
+        return Layout::idx(x, y, width);
+    }
+    Vec2ui coords(const size_t& i) const { return Layout::coords(i, width); }
+    // elements in storage, including the padding of the layout
+    size_t size() const { return Layout::storageSize(width, height); }
     T* ptr() { return data.get(); }
+    const T* ptr() const { return data.get(); }
+
+    // calls fn(x, y, i) for the cells of rows [row_begin, row_end) in storage order,
+    // tile by tile; rows and columns beyond the array are the padding of the layout
+    template <typename Fn>
+    void forEachCell(const size_t& row_begin, const size_t& row_end, const Fn& fn) const {
+        const size_t tile_width = Layout::tileWidth(width);
+        const size_t tile_height = Layout::tileHeight();
+        const size_t tile_cells = tile_width * tile_height;
+        for (size_t tile_y = row_begin / tile_height * tile_height; tile_y < row_end;
+             tile_y += tile_height) {
+            size_t i = Layout::idx(0, tile_y, width);
+            const bool whole = tile_y >= row_begin && tile_y + tile_height <= row_end;
+            for (size_t tile_x = 0; tile_x < width; tile_x += tile_width) {
+                for (size_t j = 0; j < tile_cells; ++j, ++i) {
+                    Vec2ui c = Layout::local(j);
+                    size_t y = tile_y + c.y;
+                    if (whole || (y >= row_begin && y < row_end)) {
+                        fn(tile_x + c.x, y, i);
+                    }
+                }
+            }
+        }
+    }
 };
 
 }  // namespace gbhs
@@ -0,0 +1,68 @@
+// compares Manning::cellOutflow (precomputed flow coefficient, fastPow2_3) with the
+// original powf / sqrtf formula, fails if the relative deviation exceeds the bound
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "manning.hpp"
+
+namespace {
+
+// relative error bound of fastPow2_3, see fast_math.hpp
+constexpr double max_deviation = 2e-5;
+
+constexpr float channel_width = 0.5f;  // w, as in manning.cpp
+constexpr float roughness = 0.035f;    // r
+constexpr float dt = 0.1f;             // [sec]
+
+// the step before the flow coefficients were precomputed
+float originalOutflow(const gbhs::SimulationData& data,
+                      const size_t& cell_idx,
+                      const size_t& neighbor,
+                      const float& h) {
+    const float w = channel_width;
+    const float r = roughness;
+    float s = std::abs(data.cellGradient(neighbor, cell_idx));
+    float l = data.cellDistance(cell_idx, neighbor);
+    float outflow = (dt / (l * w)) * w * h * (1.f / r) *
+                    powf((w * h) / (w + 2.f * h), 2.f / 3.f) * sqrtf(s);
+    return std::min(outflow, h);
+}
+
+}  // namespace
+
+int main() {
+    // h in [1e-9, 20] m and slopes in [1e-4, 50], towards a cardinal and a diagonal
+    // neighbour: the center of a 3x3 window drains into its lower right neighbours
+    double max_found = 0.0;
+    for (const gbhs::Vec2ui& target : {gbhs::Vec2ui{2, 1}, gbhs::Vec2ui{2, 2}}) {
+        const float distance = target.y == 1 ? 1.f : std::sqrt(2.f);
+        for (double slope = 1e-4; slope <= 50.0; slope *= 1.05) {
+            gbhs::SimulationData data(3, 3);
+            std::fill_n(data.height_map.ptr(), data.height_map.size(), 1e4f);
+            data.height_map[data.cellIndex(target.x, target.y)] = 0.f;
+            data.height_map[data.cellIndex(1, 1)] = float(slope * distance);
+            data.findNeighbours();
+
+            const size_t cell_idx = data.cellIndex(1, 1);
+            const size_t neighbor = data.cellIndex(target.x, target.y);
+            if (data.neighbor(cell_idx) != int32_t(neighbor)) {
+                std::cout << "Wrong downstream cell for slope " << slope << "!"
+                          << std::endl;
+                return 1;
+            }
+            gbhs::Manning sim(data);
+            for (double h = 1e-9; h <= 20.0; h *= 1.05) {
+                data.setWaterLevel(cell_idx, float(h));
+                double expected = originalOutflow(data, cell_idx, neighbor, float(h));
+                double outflow = sim.cellOutflow(cell_idx, dt);
+                max_found = std::max(max_found, std::abs(outflow - expected) / expected);
+            }
+        }
+    }
+
+    std::cout << "max relative deviation of cellOutflow: " << max_found << " (bound "
+              << max_deviation << ")" << std::endl;
+    return max_found <= max_deviation ? 0 : 1;
+}
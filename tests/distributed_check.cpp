@@ -0,0 +1,169 @@
+// runs gbhs on a generated raster once in one process and once split into three
+// strips (--ranks 3), and compares the water of the last snapshot cell by cell; the
+// strip borders are no multiples of the tile size and the rain forcing varies in y,
+// so rain on a lattice of the strip instead of the window shows up
+//
+// distributed_check <gbhs executable>, run in an empty directory
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "little_endian.hpp"
+#include "output_container.hpp"
+#include "snapshot_format.hpp"
+
+namespace {
+
+constexpr size_t width = 180;
+constexpr size_t height = 150;  // strips of 50 rows
+constexpr size_t ranks = 3;
+constexpr double max_difference = 1e-3;  // [m], snapshots are rounded to 1e-4
+
+// the ridge at row 75 runs across the middle strip and every cell has a lower
+// neighbour towards x = 0, so water crosses both strip borders and there are no
+// depressions: a strip isn't filled, the whole window is
+bool writeTerrain(const std::string& file) {
+    std::ofstream ws(file);
+    ws << "ncols " << width << "\nnrows " << height
+       << "\nxllcorner 0\nyllcorner 0\ncellsize 1\nNODATA_value -9999\n";
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            double ridge = 75.0 - std::abs(double(y) - 75.0);
+            double bumps = 0.2 * std::sin(x / 7.0) * std::cos(y / 5.0);
+            ws << 10.0 + 0.5 * x + 0.3 * ridge + bumps << (x + 1 < width ? " " : "\n");
+        }
+    }
+    return ws.good();
+}
+
+// rain [mm/h] on a grid of 40 x 40 cells, different in every row and column and
+// above the evaporation of 3600 mm/h
+bool writeRain(const std::string& directory) {
+    std::ofstream list(directory + "/rain.txt");
+    for (size_t frame = 0; frame < 3; ++frame) {
+        std::string file = "rain" + std::to_string(frame) + ".asc";
+        list << frame * 100 << " " << file << "\n";
+        std::ofstream ws(directory + "/" + file);
+        ws << "ncols 5\nnrows 4\nxllcorner 0\nyllcorner -10\ncellsize 40\n"
+           << "NODATA_value -9999\n";
+        for (size_t j = 0; j < 4; ++j) {
+            for (size_t i = 0; i < 5; ++i) {
+                ws << 5000 + 4000 * ((i * 3 + j * 5 + frame) % 4) << (i < 4 ? " " : "\n");
+            }
+        }
+        if (!ws.good()) {
+            return false;
+        }
+    }
+    return list.good();
+}
+
+// water of the last snapshot of an output file added to levels (the window, in
+// raster order); a strip's rows are shifted by its offset in the window
+bool addWater(const std::string& file,
+              std::vector<double>& levels,
+              uint64_t& step) {
+    std::ifstream rs(file, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(rs)),
+                              std::istreambuf_iterator<char>());
+    std::vector<gbhs::ContainerChunk> chunks;
+    if (!gbhs::readContainerChunks(data.data(), data.size(), chunks)) {
+        return false;
+    }
+    const gbhs::ContainerChunk* metadata = nullptr;
+    const gbhs::ContainerChunk* last = nullptr;
+    for (const gbhs::ContainerChunk& chunk : chunks) {
+        if (chunk.type == gbhs::ChunkType::metadata) {
+            metadata = &chunk;
+        } else if (chunk.type == gbhs::ChunkType::step &&
+                   (last == nullptr || chunk.step > last->step)) {
+            last = &chunk;
+        }
+    }
+    gbhs::SnapshotReader snapshot;
+    std::vector<gbhs::OutputCell> cells;
+    if (metadata == nullptr || last == nullptr ||
+        !snapshot.open(data.data() + last->offset, last->size) ||
+        !snapshot.readAll(cells)) {
+        return false;
+    }
+    const size_t offset_y = gbhs::getU32(data.data() + metadata->offset + 4);
+    const size_t strip_width = snapshot.dimensions().x;
+    for (const gbhs::OutputCell& cell : cells) {
+        size_t y = offset_y + cell.idx / strip_width;
+        levels[cell.idx % strip_width + y * width] += cell.water_level;
+    }
+    step = last->step;
+    return true;
+}
+
+bool run(const std::string& gbhs, const std::string& directory, const std::string& args) {
+    mkdir(directory.c_str(), 0755);
+    mkdir((directory + "/output").c_str(), 0755);
+    std::string command = "cd '" + directory + "' && '" + gbhs +
+                          "' ../terrain.asc --rain ../rain.txt --window 0 0 " +
+                          std::to_string(width) + " " + std::to_string(height) + " " +
+                          args + " > gbhs.log 2>&1";
+    if (std::system(command.c_str()) != 0) {
+        std::cout << "gbhs " << args << " failed, see " << directory << "/gbhs.log!"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cout << "usage: distributed_check <gbhs executable>" << std::endl;
+        return 1;
+    }
+    const std::string gbhs = argv[1];
+    if (!writeTerrain("terrain.asc") || !writeRain(".")) {
+        std::cout << "Error writing the test data!" << std::endl;
+        return 1;
+    }
+    if (!run(gbhs, "single", "") ||
+        !run(gbhs, "strips", "--ranks " + std::to_string(ranks))) {
+        return 1;
+    }
+
+    std::vector<double> single(width * height, 0.0);
+    std::vector<double> strips(width * height, 0.0);
+    uint64_t single_step = 0;
+    if (!addWater("single/output/run.gbhs", single, single_step)) {
+        std::cout << "Error reading the output of the single run!" << std::endl;
+        return 1;
+    }
+    for (size_t rank = 0; rank < ranks; ++rank) {
+        uint64_t step = 0;
+        std::string file = "strips/output/run." + std::to_string(rank) + ".gbhs";
+        if (!addWater(file, strips, step) || step != single_step) {
+            std::cout << "Error reading the last step of '" << file << "'!" << std::endl;
+            return 1;
+        }
+    }
+
+    double max_found = 0.0;
+    double single_water = 0.0;
+    double strips_water = 0.0;
+    for (size_t i = 0; i < single.size(); ++i) {
+        max_found = std::max(max_found, std::abs(single[i] - strips[i]));
+        single_water += single[i];
+        strips_water += strips[i];
+    }
+    std::cout << "step " << single_step << ": " << single_water << " m of water in one "
+              << "process, " << strips_water << " m in " << ranks
+              << " strips, max difference " << max_found << " m (bound "
+              << max_difference << ")" << std::endl;
+    return single_water > 0.0 && max_found <= max_difference ? 0 : 1;
+}
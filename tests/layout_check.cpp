@@ -0,0 +1,120 @@
+// checks that idx, coords and forEachCell of every Array2D layout agree: idx and
+// coords are inverses on the whole padded grid, idx hits every element of the
+// storage once, and forEachCell visits the elements of a row range in storage order
+// with their coordinates; also neighbourIndex of SimulationData against idx
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "simulation_data.hpp"
+
+namespace {
+
+// odd sizes, so the border tiles are padded
+const gbhs::Vec2ui sizes[] = {{1, 1}, {3, 5}, {64, 64}, {65, 63}, {130, 70}, {200, 129}};
+
+bool fail(const std::string& layout, const gbhs::Vec2ui& size, const std::string& what) {
+    std::cout << layout << " " << size.x << "x" << size.y << ": " << what << "!"
+              << std::endl;
+    return false;
+}
+
+template <typename Layout>
+bool check(const std::string& name, const gbhs::Vec2ui& size) {
+    gbhs::Array2D<char, Layout> array(size.x, size.y);
+    // the grid the storage covers, padding included
+    const size_t tile_width = Layout::tileWidth(size.x);
+    const size_t tile_height = Layout::tileHeight();
+    const size_t padded_width = (size.x + tile_width - 1) / tile_width * tile_width;
+    const size_t padded_height = (size.y + tile_height - 1) / tile_height * tile_height;
+    if (padded_width * padded_height != array.size()) {
+        return fail(name, size, "storage size is not the padded grid");
+    }
+
+    std::vector<int> hits(array.size(), 0);
+    for (size_t y = 0; y < padded_height; ++y) {
+        for (size_t x = 0; x < padded_width; ++x) {
+            size_t i = array.idx(x, y);
+            if (i >= array.size()) {
+                return fail(name, size, "idx beyond the storage");
+            }
+            gbhs::Vec2ui c = array.coords(i);
+            if (c.x != x || c.y != y) {
+                return fail(name, size, "coords is not the inverse of idx");
+            }
+            ++hits[i];
+        }
+    }
+    for (const int& count : hits) {
+        if (count != 1) {
+            return fail(name, size, "idx doesn't hit every element once");
+        }
+    }
+
+    // whole grid and ranges that start and end inside tiles
+    const std::vector<std::pair<size_t, size_t>> ranges = {
+        {0, padded_height}, {0, size.y}, {size.y / 3, size.y / 3 + size.y / 2 + 1}};
+    for (const auto& range : ranges) {
+        std::vector<size_t> visited;
+        bool coords_match = true;
+        array.forEachCell(range.first, range.second, [&](size_t x, size_t y, size_t i) {
+            gbhs::Vec2ui c = array.coords(i);
+            coords_match = coords_match && c.x == x && c.y == y;
+            visited.push_back(i);
+        });
+        if (!coords_match) {
+            return fail(name, size, "forEachCell passes coordinates other than coords");
+        }
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < array.size(); ++i) {
+            size_t y = array.coords(i).y;
+            if (y >= range.first && y < range.second) {
+                expected.push_back(i);
+            }
+        }
+        if (visited != expected) {
+            return fail(name,
+                        size,
+                        "forEachCell of rows " + std::to_string(range.first) + " to " +
+                            std::to_string(range.second) + " not in storage order");
+        }
+    }
+    return true;
+}
+
+// the cells of the padded grid whose 8 neighbours are in it
+bool checkNeighbourIndex(const gbhs::Vec2ui& size) {
+    constexpr int dx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+    constexpr int dy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+    gbhs::SimulationData data(size.x, size.y);
+    const gbhs::TileGrid& grid = data.tileGrid();
+    for (size_t y = 1; y + 1 < grid.tiles_y * gbhs::tile_size; ++y) {
+        for (size_t x = 1; x + 1 < grid.tiles_x * gbhs::tile_size; ++x) {
+            for (size_t d = 0; d < 8; ++d) {
+                if (data.neighbourIndex(data.cellIndex(x, y), d) !=
+                    data.cellIndex(x + dx[d], y + dy[d])) {
+                    return fail("neighbourIndex", size, "differs from the cell index");
+                }
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    for (const gbhs::Vec2ui& size : sizes) {
+        if (!check<gbhs::RowMajorLayout>("row-major", size) ||
+            !check<gbhs::TiledLayout<2>>("tiled 4", size) ||
+            !check<gbhs::CellLayout>("cell layout", size) ||
+            !check<gbhs::MortonTiledLayout<2>>("morton 4", size) ||
+            !check<gbhs::MortonTiledLayout<gbhs::tile_bits>>("morton 64", size) ||
+            !checkNeighbourIndex(size)) {
+            return 1;
+        }
+    }
+    std::cout << "idx, coords and forEachCell agree for all layouts" << std::endl;
+    return 0;
+}
@@ -0,0 +1,89 @@
+// stress test of TileScheduler: every task runs exactly once for any thread count,
+// weights and steal grain; steals() counts the steals of a run
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "tile_scheduler.hpp"
+
+namespace {
+
+constexpr size_t runs_per_pool = 300;
+
+// skewed weights, most tasks are empty like owners without wet cells
+bool stress(const size_t& threads, std::mt19937& rng) {
+    gbhs::ThreadPool pool(threads);
+    gbhs::TileScheduler scheduler(pool);
+    size_t steals = 0;
+    for (size_t run = 0; run < runs_per_pool; ++run) {
+        std::vector<size_t> weights(rng() % 200);
+        for (size_t& weight : weights) {
+            weight = rng() % 4 == 0 ? rng() % 1000 : 0;
+        }
+        scheduler.setStealGrain(1 + rng() % 5);
+
+        std::vector<std::atomic<int>> calls(weights.size());
+        scheduler.run(weights, [&](size_t task, size_t) {
+            calls[task].fetch_add(1, std::memory_order_relaxed);
+            // work in proportion to the weight
+            volatile size_t sum = 0;
+            for (size_t i = 0; i < weights[task] * 20; ++i) {
+                sum = sum + i;
+            }
+        });
+        for (size_t task = 0; task < calls.size(); ++task) {
+            if (calls[task] != 1) {
+                std::cout << threads << " threads, run " << run << ": task " << task
+                          << " ran " << calls[task] << " times!" << std::endl;
+                return false;
+            }
+        }
+        steals += scheduler.steals();
+    }
+    if (threads == 1 && steals > 0) {
+        std::cout << "A single thread stole " << steals << " times!" << std::endl;
+        return false;
+    }
+    std::cout << threads << " threads: " << runs_per_pool << " runs, " << steals
+              << " steals" << std::endl;
+    return true;
+}
+
+// the second thread blocks in its first task until all others are done, so they
+// can only have been taken by stealing from its run
+bool forcedSteal() {
+    gbhs::ThreadPool pool(2);
+    gbhs::TileScheduler scheduler(pool);
+    const std::vector<size_t> weights(64, 1);
+    std::atomic<size_t> done{0};
+    scheduler.run(weights, [&](size_t, size_t thread_idx) {
+        auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (thread_idx == 1 && done.load() + 1 < weights.size() &&
+               std::chrono::steady_clock::now() < give_up) {
+            std::this_thread::yield();
+        }
+        done.fetch_add(1);
+    });
+    if (done != weights.size() || scheduler.steals() == 0) {
+        std::cout << "No steal from a blocked thread, " << done << " of "
+                  << weights.size() << " tasks ran!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    std::mt19937 rng(1);
+    for (size_t threads : {1, 2, 3, 4, 8}) {
+        if (!stress(threads, rng)) {
+            return 1;
+        }
+    }
+    return forcedSteal() ? 0 : 1;
+}
@@ -1,22 +1,84 @@
 import struct
+import lz4.block  # pip install lz4
 import numpy as np
 from matplotlib import pyplot as plt
 
-path = "build/output/metadata.bin"
-f = open(path, "rb")
-
 # see https://docs.python.org/3/library/struct.html for details
+
+
+def read_chunks(path):
+    # see README "Output container"; scanning stops at the first incomplete
+    # chunk, so this also reads runs that crashed
+    f = open(path, "rb")
+    data = f.read()
+    f.close()
+    magic, version = struct.unpack_from("<8sI", data, 0)
+    assert magic == b"GBHSRUN\0" and version == 1
+
+    chunks = []
+    pos = 16
+    while pos + 32 <= len(data):
+        magic, kind, step, size, checksum = struct.unpack_from("<4sIQQQ", data, pos)
+        if magic != b"GBHC" or pos + 32 + size > len(data):
+            break
+        if kind != 3:  # index
+            chunks.append((kind, step, data[pos + 32:pos + 32 + size]))
+        pos += 32 + size
+    return chunks
+
+
+def read_varints(raw, pos, count):
+    values = []
+    for _ in range(count):
+        value = 0
+        shift = 0
+        while True:
+            b = raw[pos]
+            pos += 1
+            value |= (b & 0x7f) << shift
+            shift += 7
+            if b < 0x80:
+                break
+        values.append(value)
+    return values, pos
+
+
+def read_step(data):
+    # see README "Water level data"
+    magic, version, width, height, tile_size, precision, count = struct.unpack_from(
+        "<8sIIIIfI", data, 0)
+    assert magic == b"GBHSSNAP" and version == 1
+    index_offset, block_count, index_magic = struct.unpack_from("<QI4s", data, len(data) - 16)
+    assert index_magic == b"GBHI"
+
+    tiles_x = (width + tile_size - 1) // tile_size
+    cells = []
+    for i in range(block_count):
+        tile, cell_count, offset, compressed_size, raw_size = struct.unpack_from(
+            "<IIQII", data, index_offset + 24 * i)
+        raw = data[offset:offset + compressed_size]
+        if compressed_size != raw_size:
+            raw = lz4.block.decompress(raw, uncompressed_size=raw_size)
+        deltas, pos = read_varints(raw, 0, cell_count)
+        levels, pos = read_varints(raw, pos, cell_count)
+        local = 0
+        for delta, level in zip(deltas, levels):
+            local += delta
+            x = tile % tiles_x * tile_size + local % tile_size
+            y = tile // tiles_x * tile_size + local // tile_size
+            cells.append((x, y, level * precision))
+    return cells
+
+
+chunks = read_chunks("build/output/run.gbhs")
+
 # metadata
-# TODO c++ padding???
-raw_data = f.read(struct.calcsize("<iiiiffQ"))  # file layout
-data = struct.unpack("<iiiiffQ", raw_data)
+metadata = chunks[0][2]
+offset_x, offset_y, width, height, dt, output_resolution = struct.unpack_from(
+    "<iiiifQ", metadata, 0)
 
 # height data (array)
-width = data[2]
-height = data[3]
-raw_data = f.read(struct.calcsize("<f") * width * height)
-f.close()
-height_data = struct.unpack("f" * width * height, raw_data)
+height_data = np.frombuffer(metadata, dtype="<f4", count=width * height, offset=28)
 
 # visualize height data
 arr = np.repeat(np.array(height_data), 3)  # 3 channels for RGB
@@ -27,35 +89,16 @@ arr2d = ((arr2d - arr2d.min()) * (1/(arr2d.max() - arr2d.min()) * 255)
 imgplot = plt.imshow(arr2d)
 plt.show()
 
-filepath = "build/output/step_"
-for i in range(0, 10):
+for kind, step, data in chunks[1:11]:
     # reset
     arr2d = np.zeros((height, width))
 
     # read water level data
-    ifilepath = filepath + str(i) + ".bin"
-    f = open(ifilepath, "rb")
-    raw_data = f.read(struct.calcsize("<I"))  # file layout
-    length = struct.unpack("<I", raw_data)[0]
-    raw_data = f.read((struct.calcsize("<II")) * length)
-    water_data = struct.unpack("II" * length, raw_data)
-    f.close()
-
-    # visualize water level data
-    blue = np.array([0, 0, 255])
-    white = np.array([255, 255, 255])
-    for i in range(0, length):
-        x = water_data[i*2] % width
-        y = int(water_data[i*2] / height)
-        h = water_data[i*2+1]
-        # opacity = h / 1000  # TODO water level scale
-        # new_color = (opacity * blue + (1-opacity)
-        #              * arr2d[y][x]).astype(np.int64)
-        # new_color = white * opacity
+    for x, y, h in read_step(data):
         arr2d[y][x] = h
 
-    print(arr2d.max())
+    print(step, arr2d.max())
     arr2d = ((arr2d - arr2d.min()) * (1/(arr2d.max() - arr2d.min()) * 255)
-            ).astype('uint8')  # scale to 0-255
+             ).astype('uint8')  # scale to 0-255
     imgplot = plt.imshow(arr2d)
     plt.show()